@@ -41,6 +41,7 @@
 #include "sl_code_classification.h"
 
 #include "app_assert.h"
+#include "app_log.h"
 #include "app_button_press.h"
 #include "hcs300.h"
 
@@ -52,6 +53,37 @@
 //                              Macros and Typedefs
 // -----------------------------------------------------------------------------
 
+// The code words are encoded in place into this buffer and handed over to RAIL
+// as its TX FIFO, the TX FIFO of the RAIL util init is disabled
+// (SL_RAIL_UTIL_INIT_TX_FIFO_INST0_BYTES). Power of 2 between 64 and 4096.
+#define APP_TX_FIFO_BYTES 256
+
+// Events ending a transmission, the TX FIFO buffer is free again
+#define APP_TX_DONE_EVENTS (SL_RAIL_EVENT_TX_PACKET_SENT \
+                            | SL_RAIL_EVENT_TX_ABORTED   \
+                            | SL_RAIL_EVENT_TX_BLOCKED   \
+                            | SL_RAIL_EVENT_TX_UNDERFLOW)
+
+typedef enum app_tx_state {
+  // The TX FIFO buffer is free to encode into
+  APP_TX_STATE_IDLE,
+  // A code word is being sent, the buffer belongs to RAIL until a TX done
+  // event
+  APP_TX_STATE_ACTIVE,
+} app_tx_state_t;
+
+// Packet received while the previous one is being sent
+typedef struct app_tx_packet {
+  uint16_t hcs300_id;
+  const hcs300_protocol_t *protocol;
+  bool     rpt;
+  bool     vlow;
+  uint8_t  btn_status;
+  uint32_t serial;
+  uint32_t encrypted;
+  uint8_t  trailer;
+} app_tx_packet_t;
+
 // -----------------------------------------------------------------------------
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
@@ -60,6 +92,8 @@ static void proceed(void);
 
 static void step(void);
 
+static void start_tx(const app_tx_packet_t *packet);
+
 // -----------------------------------------------------------------------------
 //                                Global Variables
 // -----------------------------------------------------------------------------
@@ -69,6 +103,21 @@ static void step(void);
 // -----------------------------------------------------------------------------
 static volatile uint32_t proceed_requested = 0;
 
+static union {
+  sl_rail_fifo_buffer_align_t align;
+  uint8_t bytes[APP_TX_FIFO_BYTES];
+} tx_fifo[1];
+
+static volatile app_tx_state_t tx_state = APP_TX_STATE_IDLE;
+
+// The last packet received during a transmission, sent after it (main loop
+// only)
+static app_tx_packet_t tx_pending;
+static bool tx_pending_valid = false;
+
+// Received packets which couldn't be encoded for the PHY
+static uint32_t tx_dropped = 0;
+
 // -----------------------------------------------------------------------------
 //                          Public Function Definitions
 // -----------------------------------------------------------------------------
@@ -91,7 +140,12 @@ void app_process_action(void)
 SL_CODE_RAM void sl_rail_util_on_event(sl_rail_handle_t rail_handle, sl_rail_events_t events)
 {
   (void) rail_handle;
-  (void) events;
+
+  if (events & APP_TX_DONE_EVENTS) {
+    // The pending packet (if any) is sent by the main loop
+    tx_state = APP_TX_STATE_IDLE;
+    proceed();
+  }
 
   ///////////////////////////////////////////////////////////////////////////
   // Put your RAIL event handling here!                                    //
@@ -136,38 +190,42 @@ static void step(void)
   CORE_EXIT_CRITICAL();
   if (run_step) {
     hcs300_step();
+
+    if (tx_state == APP_TX_STATE_IDLE && tx_pending_valid) {
+      tx_pending_valid = false;
+      start_tx(&tx_pending);
+    }
   }
 }
 
 void hcs300_on_rx_packet(uint16_t hcs300_id,
+                         const hcs300_protocol_t *protocol,
                          bool rpt,
                          bool vlow,
                          uint8_t btn_status,
                          uint32_t serial,
-                         uint32_t encrypted)
+                         uint32_t encrypted,
+                         uint8_t trailer)
 {
-  uint8_t codeword_data[HCS300_CODEWORD_DATA_BYTES];
-  uint16_t codeword_data_len = sizeof(codeword_data);
+  const app_tx_packet_t packet = {
+    .hcs300_id = hcs300_id,
+    .protocol = protocol,
+    .rpt = rpt,
+    .vlow = vlow,
+    .btn_status = btn_status,
+    .serial = serial,
+    .encrypted = encrypted,
+    .trailer = trailer,
+  };
 
-  sl_status_t sc = hcs300_create_codeword_data(hcs300_id,
-                                               codeword_data,
-                                               &codeword_data_len,
-                                               rpt,
-                                               vlow,
-                                               btn_status,
-                                               serial,
-                                               encrypted);
-  app_assert_status(sc);
+  if (tx_state != APP_TX_STATE_IDLE) {
+    // The buffer is being sent, only the last packet is kept
+    tx_pending = packet;
+    tx_pending_valid = true;
+    return;
+  }
 
-  sl_rail_handle_t rail_handle = sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0);
-  volatile int32_t tx_power_dbm = sl_rail_get_tx_power_dbm(rail_handle);
-  sc = sl_rail_set_tx_power_dbm(rail_handle, 100);
-  app_assert_status(sc);
-  uint16_t tx_len = sl_rail_write_tx_fifo(rail_handle, codeword_data, sizeof(codeword_data), true);
-  app_assert_s(tx_len == sizeof(codeword_data));
-  sc = sl_rail_start_tx(rail_handle, 0, SL_RAIL_TX_OPTIONS_DEFAULT, NULL);
-  app_assert_status(sc);
-  sl_rail_delay_us(rail_handle, 100000);
+  start_tx(&packet);
 }
 
 void app_button_press_cb(uint8_t button, uint8_t duration)
@@ -184,3 +242,52 @@ void app_button_press_cb(uint8_t button, uint8_t duration)
   }
 
 }
+
+static void start_tx(const app_tx_packet_t *packet)
+{
+  uint16_t codeword_data_len = sizeof(tx_fifo->bytes);
+
+  // The previous code word has been sent, the buffer is free to encode into
+  sl_status_t sc = hcs300_create_codeword_data(packet->hcs300_id,
+                                               packet->protocol,
+                                               tx_fifo->bytes,
+                                               &codeword_data_len,
+                                               packet->rpt,
+                                               packet->vlow,
+                                               packet->btn_status,
+                                               packet->serial,
+                                               packet->encrypted,
+                                               packet->trailer);
+  if (sc == SL_STATUS_NOT_SUPPORTED) {
+    // The TE of the packet can't be sent with the bit period of the PHY (see
+    // hcs300_relay_te_us), the TX state stays idle for the next packet
+    tx_dropped++;
+    app_log_warning("HCS300 packet not relayed, TE not supported by the PHY (%lu)" APP_LOG_NL,
+                    tx_dropped);
+    return;
+  }
+  app_assert_status(sc);
+
+  sl_rail_handle_t rail_handle = sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0);
+  volatile int32_t tx_power_dbm = sl_rail_get_tx_power_dbm(rail_handle);
+  sc = sl_rail_set_tx_power_dbm(rail_handle, 100);
+  app_assert_status(sc);
+  // The encoded code word becomes the content of the TX FIFO, nothing is copied
+  uint16_t fifo_len = sl_rail_set_tx_fifo(rail_handle,
+                                          &tx_fifo->align,
+                                          codeword_data_len,
+                                          sizeof(tx_fifo->bytes));
+  app_assert_s(fifo_len == sizeof(tx_fifo->bytes));
+  // The PHY has a fixed length frame (after its KEELOQ preamble and header),
+  // the data portions of the protocols have different lengths. The frame is
+  // set to the bytes written into the TX FIFO, HCS300_PHY_FIXED_LENGTH_BYTES
+  // for HCS300 code words at 1 chip per TE. The guard time is part of the
+  // frame, TX_PACKET_SENT comes at its end, so the next code word can be
+  // started right away.
+  sc = sl_rail_set_fixed_length(rail_handle, codeword_data_len);
+  app_assert_status(sc);
+  // Completion is signaled by the TX done events, the main loop goes on
+  tx_state = APP_TX_STATE_ACTIVE;
+  sc = sl_rail_start_tx(rail_handle, 0, SL_RAIL_TX_OPTIONS_DEFAULT, NULL);
+  app_assert_status(sc);
+}
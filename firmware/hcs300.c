@@ -4,6 +4,7 @@
 #include <assert.h>
 
 #include "hcs300.h"
+#include "hcs300_decoder.h"
 #include "util.h"
 
 #include "app_log.h"
@@ -12,8 +13,10 @@
 
 #include "sl_status.h"
 #include "sl_common.h"
+#include "sl_core.h"
 
 #include "sl_clock_manager.h"
+#include "sl_gpio.h"
 #include "sl_hal_gpio.h"
 #include "sl_hal_timer.h"
 #include "sl_interrupt_manager.h"
@@ -24,8 +27,6 @@
 #include "sl_power_manager.h"
 #endif
 
-#include "dmadrv.h"
-
 // TODO: Remove temporary workaround for missing comma in macro
 #undef app_log_array_dump_level
 #define app_log_array_dump_level(level, p_data, len, format) \
@@ -36,44 +37,145 @@ app_log_array_dump_level_s(level,                          \
   format)
 
 
-// 50% duty cycle preamble means 12 pulses (half as many rounded down)
-#define HCS300_PREAMBLE_PULSES        ((HCS300_PREAMBLE_TE + 1) / 2)
-
-// HCS300 supports 4 buttons
-#define HCS300_BUTTON_CODE_BITS        4
-
-// Serial number stored in HCS300
-#define HCS300_SERIAL_NUM_BITS        28
-
-#define HCS300_SERIAL_NUM_OFFSET      HCS300_ENCRYPTED_BITS
-#define HCS300_BUTTON_CODE_OFFSET     (HCS300_SERIAL_NUM_OFFSET + HCS300_SERIAL_NUM_BITS)
-#define HCS300_VLOW_OFFSET            (HCS300_BUTTON_CODE_OFFSET + HCS300_BUTTON_CODE_BITS)
-#define HCS300_RPT_OFFSET             (HCS300_VLOW_OFFSET + 1)
-
-#define HCS300_MAX_PULSES             (HCS300_PREAMBLE_PULSES + HCS300_DATA_BITS)
-#define HCS300_MAX_EDGES              (2 * HCS300_MAX_PULSES)
-
-#define HCS300_MIN_CAPTURES(min_preamble_pulses) \
-        (2 * ((min_preamble_pulses) + HCS300_DATA_BITS))
-
+// The capture buffer is sized for the longest frame of the supported
+// protocols (HCS362 Manchester, every bit split into two levels).
 // There is an extra capture at the beginning when the first edge is detected.
 // The first capture is always zero because the timer is stopped but in order
 // to use DMA to transfer the capture values we need to reserve space for it.
 // On the other hand, the last bit has 1 or 2 TE low at the end which is
 // followed by TG guard time where no signal is sent which means low level is
 // detected. There isn't any capture for the last low level, and consequently
-// no space is needed to store it, however space is allocated for the last
-// 1 or 2 TE low duration (stored manually) on PWM pin to ease the processing logic.
-#define HCS300_MAX_CAPTURES         (HCS300_MAX_EDGES + 1)
+// no space is needed to store it, the decoder decides the last bit from its
+// high level only.
+// Every spike removed by the glitch filter costs two more captures, a few of
+// them are tolerated in a frame.
+#define HCS300_GLITCH_CAPTURES      8
+#define HCS300_MAX_CAPTURES         (1 + HCS300_PROTOCOL_MAX_LEVELS + HCS300_GLITCH_CAPTURES)
+
+// The capture buffer (frame slots) is only needed by the buffered decoder,
+// it can be left out when every frame is decoded on the fly (streaming mode).
+#ifndef HCS300_CAPTURE_BUFFER_ENABLE
+#define HCS300_CAPTURE_BUFFER_ENABLE  1
+#endif
+
+// DMA capture mode (the LDMA ring and the DMADRV channel) is left out unless
+// enabled, the other capture modes don't need it.
+#ifndef HCS300_DMA_CAPTURE_ENABLE
+#define HCS300_DMA_CAPTURE_ENABLE     0
+#endif
+
+#if HCS300_DMA_CAPTURE_ENABLE
+#include "dmadrv.h"
+#endif
+
+// In DMA capture mode LDMA writes the capture values into a ring buffer which
+// is never stopped, the captures of a codeword are collected from the ring at
+// the end of the codeword. Power of 2 length to ease the index wrapping, it
+// shall be able to hold at least one complete codeword.
+#if HCS300_DMA_CAPTURE_ENABLE
+#define HCS300_DMA_RING_LEN         256
+
+static_assert(HCS300_DMA_RING_LEN >= HCS300_MAX_CAPTURES,
+              "DMA ring can't hold a complete codeword");
+static_assert((HCS300_DMA_RING_LEN & (HCS300_DMA_RING_LEN - 1)) == 0,
+              "DMA ring length shall be power of 2");
+#endif
+
+// Number of decoded frames kept in symbol-quantized form for diagnostics
+// (hcs300_get_history_frame), 0 disables the history. Power of 2, one slot is
+// reserved for the frame being recorded.
+#ifndef HCS300_SYMBOL_HISTORY_DEPTH
+#define HCS300_SYMBOL_HISTORY_DEPTH 8
+#endif
+
+// RAM budget of the receive buffers, the frame slots (if enabled) and the
+// symbol history together
+#ifndef HCS300_RX_BUFFER_RAM_BYTES
+#define HCS300_RX_BUFFER_RAM_BYTES  3072
+#endif
+
+#if HCS300_SYMBOL_HISTORY_DEPTH
+static_assert((HCS300_SYMBOL_HISTORY_DEPTH & (HCS300_SYMBOL_HISTORY_DEPTH - 1)) == 0,
+              "Symbol history depth shall be power of 2");
+#endif
+
+// Number of preamble levels averaged to detect the TE of a frame (TE is not
+// configured), power of 2. The thresholds of the frame follow the TE after it.
+#define HCS300_TE_DETECT_LEVELS     4
+
+// TIMER0 is 32 bit wide, the free-running timebase uses the full range
+#define HCS300_TIMER_MAX_COUNT      UINT32_MAX
+
+// Number of frame slots handed over from the capture ISR to the main loop.
+// While a frame is decoded the next one can be captured into another slot.
+#define HCS300_FRAME_SLOTS          2
+
+static_assert((HCS300_FRAME_SLOTS & (HCS300_FRAME_SLOTS - 1)) == 0,
+              "Frame slot count shall be power of 2");
 
-#define HCS300_DATA_BITS_CAPTURES   (2 * HCS300_DATA_BITS)
+// Number of packets decoded in ISR context (streaming mode) waiting for the
+// main loop.
+#define HCS300_PACKET_SLOTS         4
 
+static_assert((HCS300_PACKET_SLOTS & (HCS300_PACKET_SLOTS - 1)) == 0,
+              "Packet slot count shall be power of 2");
 
-#define HCS300_CODEWORD_TE          (HCS300_PREAMBLE_TE     \
-                                     + HCS300_HEADER_GAP_TE \
-                                     + HCS300_DATA_BITS_TE)
+// Number of protocols the frames are matched against (protocol registry)
+#define HCS300_MAX_PROTOCOLS        6
 
+// The fixed parts of the sent code words are prepared for the TE of the sent
+// packets, the preamble template holds up to this many chips per TE
+#define HCS300_TX_TEMPLATE_CHIPS_PER_TE 4
+#define HCS300_TX_PREAMBLE_BYTES    ((HCS300_PREAMBLE_TE * HCS300_TX_TEMPLATE_CHIPS_PER_TE + 7) >> 3)
 
+static_assert(HCS300_PHY_FIXED_LENGTH_BYTES == ((HCS300_DATA_BITS_TE + HCS300_GUARD_TE + 7) >> 3),
+              "PHY fixed length shall be the HCS300 data portion with the guard time");
+
+// Number of recently received codes remembered to suppress the repeated
+// frames of a press, the least recently seen one is replaced
+#ifndef HCS300_DUP_CACHE_SIZE
+#define HCS300_DUP_CACHE_SIZE       4
+#endif
+
+
+
+typedef enum hcs300_capture_mode {
+  // CC0 interrupt on every edge, captures are copied by the CPU
+  HCS300_CAPTURE_MODE_IRQ,
+  // Interrupt when the capture FIFO is full (2 captures), the CPU drains
+  // both captures at once. The last odd capture of a frame is collected at
+  // the end of frame (guard time, idle compare or deadline).
+  HCS300_CAPTURE_MODE_IRQ_BATCHED,
+  // Captures are moved by LDMA, CPU is woken up only at the end of codeword
+  HCS300_CAPTURE_MODE_DMA,
+} hcs300_capture_mode_t;
+
+typedef enum hcs300_timebase {
+  // The counter is reloaded and started by every edge, so each capture is the
+  // duration of the previous level. It is stopped at the end of frame.
+  HCS300_TIMEBASE_RELOAD,
+  // The counter runs all the time and is extended to 64 bits by counting the
+  // overflows, each capture is an absolute timestamp. IRQ capture mode only,
+  // not available with em2_idle (TIMER0 isn't clocked in EM2).
+  HCS300_TIMEBASE_FREE_RUNNING,
+} hcs300_timebase_t;
+
+typedef enum hcs300_decoder_mode {
+  // Frames are captured into a frame slot and decoded by the main loop
+  HCS300_DECODER_MODE_BUFFERED,
+  // Every capture is fed to the decoder as it arrives (ISR context), the
+  // packet is ready when the last data bit is captured
+  HCS300_DECODER_MODE_STREAMING,
+} hcs300_decoder_mode_t;
+
+typedef enum hcs300_dup_policy {
+  // Every decoded packet is forwarded
+  HCS300_DUP_POLICY_FORWARD_ALL,
+  // Only the first frame of a press is forwarded
+  HCS300_DUP_POLICY_FORWARD_ONCE,
+  // The first frame and every dup_forward_every-th repeat are forwarded
+  HCS300_DUP_POLICY_FORWARD_EVERY_NTH,
+} hcs300_dup_policy_t;
 
 typedef struct hcs300_config {
   sl_gpio_t pwm_pin;
@@ -82,43 +184,186 @@ typedef struct hcs300_config {
   uint16_t  activation_time_repeat_ms;
   uint16_t  guard_time_us;
   uint16_t  te_nominal_us;
-  uint8_t   min_preamble_pulses;
-  uint8_t   te_tolerance_init_pct;
-  uint8_t   te_tolerance_prec_pct;
+  uint16_t  tx_chip_us;
+  hcs300_decoder_config_t decoder;
+  hcs300_capture_mode_t capture_mode;
+  hcs300_timebase_t timebase;
+  hcs300_decoder_mode_t decoder_mode;
+  bool      early_end_of_frame;
+  uint8_t   end_of_frame_idle_te;
+  uint8_t   frame_split_gap_te;
+  uint16_t  glitch_min_us;
+  uint8_t   glitch_min_te_pct;
+  uint8_t   combine_min_frames;
+  bool      resync;
+  // Registry of the received protocols, the first match in this order wins
+  const hcs300_protocol_t *const *protocols;
+  uint8_t   protocol_cnt;
+  hcs300_dup_policy_t dup_policy;
+  uint8_t   dup_forward_every;
+  uint16_t  dup_window_ms;
+  bool      em2_idle;
   TIMER_TypeDef *timer;
 } hcs300_config_t;
 
+typedef struct hcs300_frame_stats {
+  // Timestamps of a frame in timer ticks (free-running timebase only)
+  uint64_t start_ticks;
+  uint64_t end_ticks;
+  uint64_t gap_ticks;
+  // Capture interrupts (TIMER0 and LDMA) from the first edge until handover
+  uint16_t irq_count;
+  // Spikes removed by the glitch filter
+  uint16_t glitch_cnt;
+  // TE at the end of the frame and its drift since the preamble
+  uint32_t te_ticks;
+  int32_t  te_drift_ppm;
+  // Tolerance picked from the preamble jitter
+  uint8_t  te_tolerance_pct;
+  // TE setting of the encoder (zero until it is detected) and the spike
+  // threshold derived from it
+  uint32_t te_nominal_ticks;
+  uint32_t glitch_min_ticks;
+  // Frames combined into the packet, zero for a clean frame
+  uint8_t  combined_frames;
+  hcs300_sync_t sync;
+  const hcs300_protocol_t *protocol;
+} hcs300_frame_stats_t;
+
+typedef struct hcs300_frame {
+  volatile uint32_t captures[HCS300_MAX_CAPTURES];
+  uint16_t capture_len;
+  hcs300_frame_stats_t stats;
+} hcs300_frame_t;
+
+static_assert(HCS300_CAPTURE_BUFFER_ENABLE * HCS300_FRAME_SLOTS * sizeof(hcs300_frame_t)
+              + HCS300_SYMBOL_HISTORY_DEPTH * sizeof(hcs300_symbol_frame_t)
+              <= HCS300_RX_BUFFER_RAM_BYTES,
+              "Frame slots and symbol history exceed their RAM budget");
+
+typedef struct hcs300_rx_packet {
+  hcs300_packet_t packet;
+  hcs300_frame_stats_t stats;
+} hcs300_rx_packet_t;
+
+// A code received recently, repeated frames of a press carry the same one
+typedef struct hcs300_dup_entry {
+  const hcs300_protocol_t *protocol;
+  uint32_t serial;
+  uint32_t encrypted;
+  uint8_t  btn_status;
+  // Sleeptimer ticks of the first and the last frame
+  uint32_t first_seen_ticks;
+  uint32_t last_seen_ticks;
+  // Frames of the code received after the first one
+  uint16_t repeat_cnt;
+  bool     valid;
+} hcs300_dup_entry_t;
+
+// Parts of the sent code words that only depend on the TE, rebuilt when the
+// TE of the sent packets changes
+typedef struct hcs300_tx_template {
+  uint16_t te_us;
+  // Zero if the TE isn't a multiple of the bit period of the PHY
+  uint16_t chips_per_te;
+  // KEELOQ preamble (50% duty cycle) starting with a high level, zero length
+  // if it doesn't fit
+  uint16_t preamble_chips;
+  uint8_t  preamble[HCS300_TX_PREAMBLE_BYTES];
+} hcs300_tx_template_t;
+
 typedef struct hcs300 {
   const hcs300_config_t *config;
   sl_sleeptimer_timer_handle_t activation_timer;
-  volatile uint32_t captures[HCS300_MAX_CAPTURES];
+#if HCS300_CAPTURE_BUFFER_ENABLE
+  // Single producer (TIMER0 ISR), single consumer (hcs300_step) frame queue.
+  // frame_head is only written by the ISR and frame_tail only by the main
+  // loop, a slot is owned by the main loop from publishing until released.
+  hcs300_frame_t frames[HCS300_FRAME_SLOTS];
+  hcs300_frame_t *capture_frame;
+  volatile uint8_t frame_head;
+  volatile uint8_t frame_tail;
+#endif
+  // Same handoff for the packets decoded in streaming mode
+  hcs300_glitch_filter_t stream_filter;
+  // One decoder per registered protocol fed with the same levels, the first
+  // one records the symbol history. Only the first match is published.
+  hcs300_decoder_t stream_decoders[HCS300_MAX_PROTOCOLS];
+  bool     stream_matched;
+  // Shorter frames can't be any of the registered protocols (the sync pulse
+  // of fixed-code frames split off at the sync low), they are dropped before
+  // the decoders and the history
+  uint16_t min_frame_levels;
+  // Soft bits of the last frames, used by the decoder of the frame (ISR in
+  // streaming mode, main loop in buffered mode). A gap longer than the
+  // duplicate window between two frames ends the press they belong to.
+  hcs300_combiner_t combiner;
+  uint32_t combiner_last_tick;
+  hcs300_rx_packet_t packets[HCS300_PACKET_SLOTS];
+  volatile uint8_t packet_head;
+  volatile uint8_t packet_tail;
+  volatile uint32_t dropped_frames;
+#if HCS300_SYMBOL_HISTORY_DEPTH
+  // Recorded by the decoder of the frame (ISR in streaming mode, main loop
+  // in buffered mode), the slot at history_head is the one being recorded.
+  hcs300_symbol_frame_t history[HCS300_SYMBOL_HISTORY_DEPTH];
+  volatile uint8_t history_head;
+  volatile uint8_t history_len;
+#endif
   volatile uint16_t capture_idx;
-  volatile uint16_t capture_len;
+  uint16_t idle_capture_idx;
+  int32_t  wakeup_int_no;
   uint16_t te_nominal_ticks;
+  uint32_t te_class_ticks[HCS300_TE_CLASS_INVALID];
+  // Thresholds of the frame being captured, derived from its TE. Until the TE
+  // of the frame is detected spikes are measured against the shortest TE and
+  // gaps against the longest one.
+  uint32_t frame_split_ticks;
+  uint32_t end_of_frame_idle_ticks;
+  // Configured, or forced by the glitch filter of the streaming decoder: it
+  // holds back the last level until the line is idle
+  bool     early_end_of_frame;
+  uint32_t glitch_min_us_ticks;
+  uint32_t te_detect_sum;
+  uint8_t  te_detect_cnt;
+  // TE of the re-encoded packets, follows the TE of the received ones
+  uint16_t tx_te_us;
+  hcs300_tx_template_t tx_template;
+  volatile uint32_t glitch_total;
+  volatile uint32_t split_frames;
+  // Every capture interrupt entry, irq_count of the frame is relative to it
+  uint32_t irq_count;
+  uint32_t frame_irq_start;
+  // Free-running timebase, the frame timing is updated by every capture
+  volatile uint32_t timer_overflows;
+  hcs300_frame_stats_t frame_stats;
+  uint64_t prev_frame_end_ticks;
+  uint32_t end_of_frame_deadline;
+  bool     end_of_frame_guard;
+  // Frame info of the packet being delivered (or delivered last)
+  hcs300_frame_info_t last_frame_info;
+  bool     last_frame_info_valid;
+  // Duplicate suppression in front of hcs300_on_rx_packet (main loop only)
+  hcs300_dup_entry_t dup_cache[HCS300_DUP_CACHE_SIZE];
+  uint32_t dup_window_ticks;
+  hcs300_dup_stats_t dup_stats;
+#if HCS300_DMA_CAPTURE_ENABLE
+  volatile uint32_t dma_ring[HCS300_DMA_RING_LEN];
+  uint16_t dma_ring_tail;
+  unsigned int dma_channel;
+  LDMA_Descriptor_t dma_descriptors[2];
+#endif
 } hcs300_t;
 
-typedef enum hcs300_decode_result {
-  HCS300_DECODE_OK,
-  HCS300_DECODE_ERR_INVALID_TE
-} hcs300_decode_result_t;
-
-typedef struct hcs300_decoder {
-  struct {
-    uint32_t encrypted;
-    uint32_t serial : 28;
-    uint8_t s3 : 1;
-    uint8_t s0 : 1;
-    uint8_t s1 : 1;
-    uint8_t s2 : 1;
-    uint8_t vlow : 1;
-    uint8_t rpt : 1;
-  } data;
-  uint32_t te_ticks;
-  uint32_t te_ticks_sum;
-  uint16_t capture_idx;
-  uint16_t preamble_capture_cnt;
-  uint8_t  data_bit_idx;
-} hcs300_decoder_t;
+// Frames matching several protocols (a KEELOQ PWM frame is a prefix of an
+// HCS362 PWM one, VPWM accepts the levels of any frame) are reported for the
+// first one listed
+static const hcs300_protocol_t *const hcs300_default_protocols[] = {
+  &hcs300_protocol_keeloq_pwm,
+  &hcs300_protocol_hcs362_manchester,
+  &hcs300_protocol_hcs362_vpwm,
+  &hcs300_protocol_ev1527,
+};
 
 // TODO: Hard code configuration for now
 const hcs300_config_t hcs300_default_config = {
@@ -133,44 +378,154 @@ const hcs300_config_t hcs300_default_config = {
   .activation_time_single_ms = 15,  // Debounce time on HCS300 is max 15ms
   .activation_time_repeat_ms = 500, // 500ms activation time sends 5 packets
   .guard_time_us = 10000,           // Guard time after packet is at least 10ms
-  .te_nominal_us = 400,             // Nominal TE duration is 400us
-  .min_preamble_pulses = 6,         // Minimum preamble pulses to accept packet
-  .te_tolerance_init_pct = 20,      // 20% tolerance for 1 TE
-  .te_tolerance_prec_pct =  2,      //  2% tolerance for 1 TE after calibration
+                                    // (receive side, sent code words are
+                                    // followed by HCS300_GUARD_TE)
+  .te_nominal_us = 0,               // Nominal TE duration (100, 200 or 400us),
+                                    // 0 detects it per frame from the preamble
+  .tx_chip_us = 400,                // Bit period of the PHY (2500 bps), the TE
+                                    // of sent packets is rounded to a
+                                    // multiple of it
+  .decoder = {
+    .min_preamble_pulses = 6,       // Minimum preamble pulses to accept packet
+    .te_tolerance_init_pct = 20,    // 20% tolerance for 1 TE (header detection
+                                    // and upper bound for noisy preambles)
+    .te_tolerance_prec_pct =  2,    //  2% tolerance for 1 TE after calibration
+                                    // (lower bound for clean preambles)
+    .te_tracking_shift = 3,         // TE follows 1/8 of the error of each bit
+    .max_weak_bits = 8,             // Weak bits left to the combiner per frame
+  },
+  .capture_mode = HCS300_CAPTURE_MODE_IRQ,
+  .timebase = HCS300_TIMEBASE_RELOAD,
+  .decoder_mode = HCS300_DECODER_MODE_BUFFERED, // Needed by resync
+  .early_end_of_frame = false,      // Wait for the guard time by default
+                                    // (forced by the streaming glitch filter)
+  .end_of_frame_idle_te = 3,        // Data levels are at most 2 TE long
+  .frame_split_gap_te = 16,         // Longer than header (10 TE), shorter than
+                                    // HCS300 guard time (39 TE), 0 disables
+  .glitch_min_us = 0,               // Levels shorter than the larger of the
+  .glitch_min_te_pct = 25,          // two are spikes, both 0 disables
+  .combine_min_frames = 3,          // Repeated frames voting on weak bits,
+                                    // 0 disables the combiner
+  .resync = true,                   // Search the data backward from the end
+                                    // of frame if the preamble is damaged
+                                    // (buffered decoder only, the streaming
+                                    // one doesn't keep the levels)
+  .protocols = hcs300_default_protocols,
+  .protocol_cnt = ARRAY_SIZE(hcs300_default_protocols),
+  .dup_policy = HCS300_DUP_POLICY_FORWARD_ONCE,
+  .dup_forward_every = 5,           // Every 5th repeat (EVERY_NTH policy only)
+  .dup_window_ms = 300,             // Repeats are at most ~110 ms apart, a
+                                    // lost frame is bridged, a longer pause
+                                    // is a new press
+  .em2_idle = false,                // Keep EM1 (TIMER0 clock) all the time,
+                                    // the EM2 wake-up needs the PWM pin on
+                                    // port A or B (not PD2)
   .timer = TIMER0,
 };
 
 static hcs300_t hcs300_instance = {
   .config = &hcs300_default_config,
-  .captures = {0},
+#if HCS300_CAPTURE_BUFFER_ENABLE
+  .capture_frame = NULL,
+  .frame_head = 0,
+  .frame_tail = 0,
+#endif
+  .packet_head = 0,
+  .packet_tail = 0,
+  .dropped_frames = 0,
+#if HCS300_SYMBOL_HISTORY_DEPTH
+  .history_head = 0,
+  .history_len = 0,
+#endif
+  .stream_matched = false,
+  .min_frame_levels = 0,
+  .combiner_last_tick = 0,
   .capture_idx = 0,
+  .wakeup_int_no = SL_GPIO_INTERRUPT_UNAVAILABLE,
   .te_nominal_ticks = 0,
+  .frame_split_ticks = 0,
+  .end_of_frame_idle_ticks = 0,
+  .early_end_of_frame = false,
+  .glitch_min_us_ticks = 0,
+  .te_detect_sum = 0,
+  .te_detect_cnt = 0,
+  .tx_te_us = 0,
+  .glitch_total = 0,
+  .irq_count = 0,
+  .split_frames = 0,
+  .timer_overflows = 0,
+  .prev_frame_end_ticks = 0,
+  .last_frame_info_valid = false,
+  .dup_window_ticks = 0,
 };
 
 static hcs300_t *const hcs300 = &hcs300_instance;
 
 static void init_gpio(void);
 static void init_timer(void);
+#if HCS300_DMA_CAPTURE_ENABLE
+static sl_status_t init_dma(void);
+static bool dma_block_cb(unsigned int channel,
+                         unsigned int sequence_no,
+                         void *user_param);
+static void drain_dma_ring(void);
+#endif
+static void on_capture(uint32_t capture);
+static void on_timestamp(TIMER_TypeDef *timer, uint32_t capture);
+static uint16_t drain_capture_fifo(TIMER_TypeDef *timer);
+static uint64_t extend_timestamp(TIMER_TypeDef *timer, uint32_t capture);
+static void arm_end_of_frame(TIMER_TypeDef *timer, bool guard);
+static void on_end_of_frame_deadline(TIMER_TypeDef *timer);
+static void on_end_of_frame(void);
+static void reset_stream_decoders(void);
+static void feed_stream_decoder(uint32_t duration);
+static bool is_stream_decoding(void);
+static void publish_stream_match(void);
+static bool publish_stream_packet(const hcs300_decoder_t *decoder,
+                                  sl_status_t sc);
+static void flush_stream_filter(void);
+static bool is_frame_gap(uint32_t duration);
+static void reset_frame_te(void);
+static void detect_frame_te(uint32_t duration);
+static void set_frame_te(uint32_t glitch_te_ticks, uint32_t gap_te_ticks);
+static void update_idle_compare(void);
+static void split_frame(void);
+static bool is_frame_complete(void);
+static void end_frame(TIMER_TypeDef *timer);
+static sl_status_t init_wakeup(void);
+static void wakeup_cb(uint8_t int_no, void *context);
+#if HCS300_CAPTURE_BUFFER_ENABLE
+static hcs300_frame_t *acquire_frame(void);
+static void publish_frame(void);
+static void process_frame(hcs300_frame_t *frame);
+static bool decode_frame(hcs300_decoder_t *decoder,
+                         const hcs300_protocol_t *protocol,
+                         const uint32_t *levels,
+                         uint16_t level_cnt,
+                         sl_status_t *sc);
+#endif
+static void publish_packet(const hcs300_packet_t *packet,
+                           const hcs300_frame_stats_t *stats);
+static void prepare_decoder(hcs300_decoder_t *decoder,
+                            const hcs300_protocol_t *protocol);
+static void record_history(hcs300_decoder_t *decoder);
+static void commit_history(void);
+static uint8_t combine_frame(const hcs300_decoder_t *decoder,
+                             bool clean,
+                             hcs300_packet_t *packet);
+static void deliver_packet(const hcs300_packet_t *packet,
+                           const hcs300_frame_stats_t *stats);
+static bool is_dup_forwarded(const hcs300_packet_t *packet,
+                             const hcs300_protocol_t *protocol);
 
 static void activation_timeout_cb(sl_sleeptimer_timer_handle_t *handle,
                                   void *data);
-static bool is_within_tolerance(uint32_t value,
-                                uint32_t target,
-                                uint32_t tolerance);
-static bool is_within_rel_tolerance(uint32_t value,
-                                    uint32_t target,
-                                    uint8_t rel_tolerance_pct);
 static uint32_t ticks_to_us(uint32_t ticks);
 static uint32_t us_to_ticks(uint32_t us);
-
-static bool is_te_valid(uint32_t te_measured_ticks, uint8_t rel_tolerance);
-
-static sl_status_t process_preamble_header(hcs300_t *hcs300,
-                                           hcs300_decoder_t *decoder);
-static sl_status_t process_data(hcs300_t *hcs300,
-                                hcs300_decoder_t *decoder);
+static uint64_t ticks64_to_us(uint64_t ticks);
 
 static sl_status_t create_codeword(hcs300_t *hcs300,
+                                   const hcs300_protocol_t *protocol,
                                    uint8_t *codeword,
                                    uint16_t *codeword_len,
                                    bool rpt,
@@ -178,10 +533,12 @@ static sl_status_t create_codeword(hcs300_t *hcs300,
                                    uint8_t btn_status,
                                    uint32_t serial,
                                    uint32_t encrypted,
-                                   uint16_t te_us,
+                                   uint8_t trailer,
                                    bool preamble,
                                    bool header,
                                    bool guard);
+static void build_tx_template(uint16_t te_us);
+static void append_low_chips(uint8_t *codeword, uint16_t *cw_bit_idx, uint16_t chip_cnt);
 
 sl_status_t hcs300_init(void)
 {
@@ -190,385 +547,1433 @@ sl_status_t hcs300_init(void)
   sc = sl_clock_manager_enable_bus_clock(SL_BUS_CLOCK_GPIO);
   sc = sl_clock_manager_enable_bus_clock(SL_BUS_CLOCK_TIMER0);
 
-  if (sc != SL_STATUS_OK) {
-    return sc;
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+#if !HCS300_CAPTURE_BUFFER_ENABLE
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_BUFFERED) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+#endif
+#if !HCS300_DMA_CAPTURE_ENABLE
+  if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_DMA) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+#endif
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING
+      && hcs300->config->resync) {
+    // The levels of the frame are gone by the time its preamble turns out
+    // to be damaged, resync would silently do nothing
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  if (hcs300->config->em2_idle
+      && hcs300->config->pwm_pin.port != SL_GPIO_PORT_A
+      && hcs300->config->pwm_pin.port != SL_GPIO_PORT_B) {
+    // Only the pins of port A and B wake the device up from EM2 (Series 2)
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  if (hcs300->config->timebase == HCS300_TIMEBASE_FREE_RUNNING
+      && (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_DMA
+          || hcs300->config->em2_idle)) {
+    // The end of frame deadline is re-armed by every capture in the ISR
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  if (hcs300->config->protocol_cnt == 0
+      || hcs300->config->protocol_cnt > HCS300_MAX_PROTOCOLS) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  hcs300->min_frame_levels = UINT16_MAX;
+  for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+    sc = hcs300_decoder_set_protocol(&hcs300->stream_decoders[protocol_idx],
+                                     hcs300->config->protocols[protocol_idx]);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+    hcs300->min_frame_levels = SL_MIN(hcs300->min_frame_levels,
+                                      hcs300_protocol_min_levels(hcs300->config->protocols[protocol_idx]));
+  }
+
+  if (hcs300->config->dup_policy == HCS300_DUP_POLICY_FORWARD_EVERY_NTH
+      && hcs300->config->dup_forward_every == 0) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  sc = sl_sleeptimer_ms32_to_tick(hcs300->config->dup_window_ms, &hcs300->dup_window_ticks);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  hcs300->te_nominal_ticks = us_to_ticks(hcs300->config->te_nominal_us);
+  for (uint8_t te_class = 0; te_class < HCS300_TE_CLASS_INVALID; te_class++) {
+    hcs300->te_class_ticks[te_class] = us_to_ticks(HCS300_TE_CLASS_US(te_class));
+  }
+  hcs300->glitch_min_us_ticks = us_to_ticks(hcs300->config->glitch_min_us);
+  // Without the idle compare the streaming decoder would get the last data
+  // level from the glitch filter only at the guard time overflow
+  hcs300->early_end_of_frame = hcs300->config->early_end_of_frame
+                               || (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING
+                                   && (hcs300->config->glitch_min_us != 0
+                                       || hcs300->config->glitch_min_te_pct != 0));
+  hcs300->tx_te_us = hcs300_relay_te_us(&hcs300_protocol_keeloq_pwm,
+                                        hcs300->config->te_nominal_us,
+                                        HCS300_TE_CLASS_US(HCS300_TE_CLASS_400US),
+                                        hcs300->config->tx_chip_us);
+  build_tx_template(hcs300->tx_te_us);
+  reset_frame_te();
+  hcs300_glitch_filter_reset(&hcs300->stream_filter, hcs300->frame_stats.glitch_min_ticks);
+  reset_stream_decoders();
+  hcs300_combiner_reset(&hcs300->combiner);
+
+  init_gpio();
+
+#if HCS300_DMA_CAPTURE_ENABLE
+  if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_DMA) {
+    // DMA shall be armed before the timer starts to request transfers
+    sc = init_dma();
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+#endif
+
+  init_timer();
+
+  if (hcs300->config->em2_idle) {
+    // EM1 is only required from the first edge until the end of frame
+    sc = init_wakeup();
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  } else {
+    #ifdef SL_CATALOG_POWER_MANAGER_PRESENT
+    sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+    #endif
+  }
+
+  return SL_STATUS_OK;
+}
+
+sl_status_t hcs300_deinit(void)
+{
+  // TODO
+  return SL_STATUS_NOT_SUPPORTED;
+}
+
+void hcs300_step(void)
+{
+#if HCS300_CAPTURE_BUFFER_ENABLE
+  // Decode every published frame, the ISR may publish new ones meanwhile
+  while (hcs300->frame_tail != hcs300->frame_head) {
+    hcs300_frame_t *frame = &hcs300->frames[hcs300->frame_tail & (HCS300_FRAME_SLOTS - 1)];
+
+    process_frame(frame);
+
+    // Make sure the frame is consumed before the slot is released to the ISR
+    __DMB();
+    hcs300->frame_tail++;
+  }
+#endif
+
+  // Packets already decoded in ISR context (streaming mode)
+  while (hcs300->packet_tail != hcs300->packet_head) {
+    hcs300_rx_packet_t rx = hcs300->packets[hcs300->packet_tail & (HCS300_PACKET_SLOTS - 1)];
+
+    __DMB();
+    hcs300->packet_tail++;
+
+    deliver_packet(&rx.packet, &rx.stats);
+  }
+
+  if (hcs300->split_frames != 0) {
+    app_log_debug("HCS300 back-to-back frames split (%lu)" APP_LOG_NL,
+                  hcs300->split_frames);
+    hcs300->split_frames = 0;
+  }
+
+  if (hcs300->dropped_frames != 0) {
+    app_log_warning("HCS300 frames dropped, no free slot (%lu)" APP_LOG_NL,
+                    hcs300->dropped_frames);
+    hcs300->dropped_frames = 0;
+  }
+}
+
+#if HCS300_CAPTURE_BUFFER_ENABLE
+static void process_frame(hcs300_frame_t *frame)
+{
+  sl_status_t sc = SL_STATUS_INVALID_COUNT;
+  hcs300_glitch_filter_t filter;
+  hcs300_decoder_t decoder;
+  hcs300_packet_t packet;
+  // The slot is owned by the main loop, the filtered levels are written back
+  // in place (levels are only merged, so they never overtake the captures)
+  uint32_t *levels = (uint32_t *) frame->captures;
+  uint16_t level_cnt = 0;
+  uint16_t capture_idx;
+  uint8_t  protocol_idx;
+  bool     matched = false;
+  uint32_t level;
+
+  // TODO: Add function
+  if (frame->capture_len > ARRAY_SIZE(frame->captures)) {
+    app_log_error("HCS300 capture buffer overflow (%u/%u)" APP_LOG_NL,
+                  frame->capture_len,
+                  (unsigned)ARRAY_SIZE(frame->captures));
+    return;
+  }
+
+  app_log_debug("HCS300 captures: ");
+  app_log_array_dump_debug(frame->captures, frame->capture_len, "%lu");
+  app_log_nl();
+
+  hcs300_glitch_filter_reset(&filter, frame->stats.glitch_min_ticks);
+
+  // Skip the first capture which is always zero
+  for (capture_idx = 1; capture_idx < frame->capture_len; capture_idx++) {
+    if (hcs300_glitch_filter_feed(&filter, levels[capture_idx], &level)) {
+      levels[level_cnt++] = level;
+    }
+  }
+  if (hcs300_glitch_filter_flush(&filter, &level)) {
+    // Level held back by the filter
+    levels[level_cnt++] = level;
+  }
+  hcs300->glitch_total += filter.glitch_cnt;
+
+  if (level_cnt < hcs300->min_frame_levels) {
+    // Not a frame of any registered protocol
+    return;
+  }
+
+  // The protocols are tried in registry order, the first one whose codeword
+  // ends with the frame wins
+  for (protocol_idx = 0;
+       !matched && protocol_idx < hcs300->config->protocol_cnt;
+       protocol_idx++) {
+    matched = decode_frame(&decoder,
+                           hcs300->config->protocols[protocol_idx],
+                           levels,
+                           level_cnt,
+                           &sc);
+  }
+
+  for (protocol_idx = 0;
+       !matched && hcs300->config->resync && protocol_idx < hcs300->config->protocol_cnt;
+       protocol_idx++) {
+    // Preamble or header damaged, the data may still be at the end of frame
+    prepare_decoder(&decoder, hcs300->config->protocols[protocol_idx]);
+    sc = hcs300_decoder_resync(&decoder, levels, level_cnt);
+    matched = sc == SL_STATUS_OK || hcs300_decoder_is_soft_complete(&decoder);
+    if (matched) {
+      app_log_debug("HCS300 resynchronized to data (%s)" APP_LOG_NL,
+                    (decoder.sync == HCS300_SYNC_HEADER) ? "header" : "no header");
+    }
+  }
+
+  frame->stats.glitch_cnt = filter.glitch_cnt;
+  frame->stats.te_ticks = decoder.te_ticks;
+  frame->stats.te_drift_ppm = hcs300_decoder_te_drift_ppm(&decoder);
+  frame->stats.te_tolerance_pct = decoder.tolerance_pct;
+  frame->stats.sync = decoder.sync;
+  frame->stats.protocol = decoder.protocol;
+  if (filter.glitch_cnt != 0) {
+    app_log_debug("HCS300 glitches removed: %u" APP_LOG_NL, filter.glitch_cnt);
+  }
+
+  if (decoder.state != HCS300_DECODER_STATE_PREAMBLE
+      && decoder.protocol->preamble_te != 0) {
+    app_log_debug("HCS300 preamble detected (%u pulses)" APP_LOG_NL,
+                  (decoder.preamble_capture_cnt + 1) / 2);
+    app_log_debug("HCS300 measured TE average: %lu us" APP_LOG_NL,
+                  ticks_to_us(decoder.te_ticks));
+    app_log_debug("HCS300 header detected (%lu us)" APP_LOG_NL,
+                  ticks_to_us(decoder.header_ticks));
+    app_log_debug("HCS300 TE at the end of frame: %lu us (drift %ld ppm)" APP_LOG_NL,
+                  ticks_to_us(decoder.te_ticks),
+                  hcs300_decoder_te_drift_ppm(&decoder));
+    app_log_debug("HCS300 TE tolerance from preamble jitter: %u%%" APP_LOG_NL,
+                  decoder.tolerance_pct);
+  }
+
+  commit_history();
+
+  if (sc == SL_STATUS_OK) {
+    (void) combine_frame(&decoder, true, NULL);
+    frame->stats.combined_frames = 0;
+    deliver_packet(&decoder.data, &frame->stats);
+  } else if (matched) {
+    frame->stats.combined_frames = combine_frame(&decoder, false, &packet);
+    if (frame->stats.combined_frames != 0) {
+      deliver_packet(&packet, &frame->stats);
+    }
+  }
+}
+
+// Decode the levels of a frame as the given protocol. Returns true if the
+// codeword ends with the last level of the frame, the frame is decoded (sc is
+// SL_STATUS_OK) or it can be combined with the repeated ones.
+static bool decode_frame(hcs300_decoder_t *decoder,
+                         const hcs300_protocol_t *protocol,
+                         const uint32_t *levels,
+                         uint16_t level_cnt,
+                         sl_status_t *sc)
+{
+  uint16_t level_idx;
+
+  prepare_decoder(decoder, protocol);
+
+  *sc = SL_STATUS_INVALID_COUNT;
+  for (level_idx = 0; level_idx < level_cnt; level_idx++) {
+    *sc = hcs300_decoder_feed(decoder, levels[level_idx]);
+    if (decoder->state == HCS300_DECODER_STATE_ERROR) {
+      break;
+    }
+  }
+
+  // Every level of the frame shall be consumed by the codeword (trailing
+  // sync levels included)
+  if (decoder->state == HCS300_DECODER_STATE_DONE) {
+    return true;
+  }
+
+  if (*sc == SL_STATUS_IN_PROGRESS) {
+    *sc = SL_STATUS_INVALID_COUNT;
+  }
+  return false;
+}
+#endif
+
+static void prepare_decoder(hcs300_decoder_t *decoder,
+                            const hcs300_protocol_t *protocol)
+{
+  hcs300_decoder_reset(decoder, &hcs300->config->decoder);
+  // The protocols of the registry are checked by init
+  (void) hcs300_decoder_set_protocol(decoder, protocol);
+  record_history(decoder);
+}
+
+static void record_history(hcs300_decoder_t *decoder)
+{
+#if HCS300_SYMBOL_HISTORY_DEPTH
+  hcs300_decoder_set_record(decoder,
+                            &hcs300->history[hcs300->history_head
+                                             & (HCS300_SYMBOL_HISTORY_DEPTH - 1)]);
+#else
+  (void) decoder;
+#endif
+}
+
+static void commit_history(void)
+{
+#if HCS300_SYMBOL_HISTORY_DEPTH
+  hcs300->history_head++;
+  if (hcs300->history_len < HCS300_SYMBOL_HISTORY_DEPTH - 1) {
+    hcs300->history_len++;
+  }
+#endif
+}
+
+static uint8_t combine_frame(const hcs300_decoder_t *decoder,
+                             bool clean,
+                             hcs300_packet_t *packet)
+{
+  uint32_t now_tick = sl_sleeptimer_get_tick_count();
+  uint8_t frame_cnt;
+
+  if (hcs300->config->combine_min_frames == 0
+      || !hcs300_decoder_is_soft_complete(decoder)) {
+    return 0;
+  }
+
+  // Frames of an earlier press shall not vote on this one (a stale encrypted
+  // portion would be replayed)
+  if (now_tick - hcs300->combiner_last_tick > hcs300->dup_window_ticks) {
+    hcs300_combiner_reset(&hcs300->combiner);
+  }
+  hcs300->combiner_last_tick = now_tick;
+
+  // Clean frames are delivered on their own, they only help the weak ones
+  if (hcs300_combiner_add(&hcs300->combiner,
+                          decoder,
+                          clean ? 0 : hcs300->config->combine_min_frames,
+                          packet) != SL_STATUS_OK) {
+    return 0;
+  }
+
+  // The frames of this packet shall not be combined into the next one
+  frame_cnt = hcs300->combiner.frame_cnt;
+  hcs300_combiner_reset(&hcs300->combiner);
+
+  return frame_cnt;
+}
+
+sl_status_t hcs300_get_history_frame(uint8_t age, hcs300_symbol_frame_t *frame)
+{
+#if HCS300_SYMBOL_HISTORY_DEPTH
+  sl_status_t sc = SL_STATUS_OK;
+
+  if (frame == NULL || age >= HCS300_SYMBOL_HISTORY_DEPTH - 1) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_ATOMIC();
+
+  if (age >= hcs300->history_len) {
+    // Not that many frames received yet
+    sc = SL_STATUS_NOT_FOUND;
+  } else {
+    *frame = hcs300->history[(uint8_t)(hcs300->history_head - 1 - age)
+                             & (HCS300_SYMBOL_HISTORY_DEPTH - 1)];
+  }
+
+  CORE_EXIT_ATOMIC();
+
+  return sc;
+#else
+  (void) age;
+  (void) frame;
+  return SL_STATUS_NOT_SUPPORTED;
+#endif
+}
+
+sl_status_t hcs300_get_last_frame_info(hcs300_frame_info_t *info)
+{
+  if (info == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (!hcs300->last_frame_info_valid) {
+    return SL_STATUS_NOT_FOUND;
+  }
+
+  *info = hcs300->last_frame_info;
+
+  return SL_STATUS_OK;
+}
+
+sl_status_t hcs300_get_dup_stats(hcs300_dup_stats_t *stats)
+{
+  if (stats == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  *stats = hcs300->dup_stats;
+
+  return SL_STATUS_OK;
+}
+
+sl_status_t hcs300_get_timestamp_us(uint64_t *timestamp_us)
+{
+  TIMER_TypeDef *timer = hcs300->config->timer;
+  uint64_t ticks;
+
+  if (timestamp_us == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (hcs300->config->timebase != HCS300_TIMEBASE_FREE_RUNNING) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_ATOMIC();
+  ticks = extend_timestamp(timer, sl_hal_timer_get_counter(timer));
+  CORE_EXIT_ATOMIC();
+
+  *timestamp_us = ticks64_to_us(ticks);
+
+  return SL_STATUS_OK;
+}
+
+static void deliver_packet(const hcs300_packet_t *packet,
+                           const hcs300_frame_stats_t *stats)
+{
+  hcs300->last_frame_info.start_us = ticks64_to_us(stats->start_ticks);
+  hcs300->last_frame_info.end_us = ticks64_to_us(stats->end_ticks);
+  hcs300->last_frame_info.gap_us = ticks64_to_us(stats->gap_ticks);
+  hcs300->last_frame_info.irq_count = stats->irq_count;
+  hcs300->last_frame_info.glitch_count = stats->glitch_cnt;
+  hcs300->last_frame_info.glitch_total = hcs300->glitch_total;
+  hcs300->last_frame_info.te_us = ticks_to_us(stats->te_ticks);
+  hcs300->last_frame_info.te_drift_ppm = stats->te_drift_ppm;
+  hcs300->last_frame_info.te_tolerance_pct = stats->te_tolerance_pct;
+  hcs300->last_frame_info.combined_frames = stats->combined_frames;
+  hcs300->last_frame_info.sync = stats->sync;
+  hcs300->last_frame_info.protocol = stats->protocol->name;
+  hcs300->last_frame_info_valid = true;
+
+  // Only the KEELOQ encoders have TE settings (100, 200 or 400 us)
+  hcs300->last_frame_info.te_nominal_us = (stats->protocol->preamble_te != 0)
+                                          ? (uint16_t) ticks_to_us(stats->te_nominal_ticks)
+                                          : 0;
+
+  // Packets are forwarded with the TE they have been received with, as far
+  // as the bit period of the PHY allows it
+  hcs300->tx_te_us = hcs300_relay_te_us(stats->protocol,
+                                        hcs300->last_frame_info.te_nominal_us,
+                                        hcs300->last_frame_info.te_us,
+                                        hcs300->config->tx_chip_us);
+  if (hcs300->tx_template.te_us != hcs300->tx_te_us) {
+    build_tx_template(hcs300->tx_te_us);
+  }
+
+  app_log_info("HCS300 packet received: "
+               "RPT=%u VLOW=%u S0=%u S1=%u S2=%u S3=%u "
+               "SERIAL=0x%08lX ENC=0x%08lX" APP_LOG_NL,
+               packet->rpt,
+               packet->vlow,
+               packet->s0,
+               packet->s1,
+               packet->s2,
+               packet->s3,
+               (uint32_t) packet->serial,
+               packet->encrypted);
+  app_log_debug("HCS300 protocol: %s" APP_LOG_NL, stats->protocol->name);
+  app_log_debug("HCS300 capture interrupts per frame: %u" APP_LOG_NL,
+                stats->irq_count);
+  if (stats->combined_frames != 0) {
+    app_log_debug("HCS300 packet combined from %u frames" APP_LOG_NL,
+                  stats->combined_frames);
+  }
+
+  if (!is_dup_forwarded(packet, stats->protocol)) {
+    // Repeated frame of a press already forwarded
+    return;
+  }
+
+  hcs300_on_rx_packet(0, // TODO: HCS300 ID
+                      stats->protocol,
+                      packet->rpt,
+                      packet->vlow,
+                      hcs300_packet_btn_status(packet),
+                      packet->serial,
+                      packet->encrypted,
+                      packet->trailer);
+}
+
+static bool is_dup_forwarded(const hcs300_packet_t *packet,
+                             const hcs300_protocol_t *protocol)
+{
+  uint32_t now_ticks = sl_sleeptimer_get_tick_count();
+  uint8_t btn_status = hcs300_packet_btn_status(packet);
+  hcs300_dup_entry_t *entry = NULL;
+  hcs300_dup_entry_t *oldest = &hcs300->dup_cache[0];
+  bool forward;
+
+  hcs300->dup_stats.received++;
+
+  if (hcs300->config->dup_policy == HCS300_DUP_POLICY_FORWARD_ALL) {
+    hcs300->last_frame_info.repeat_count = 0;
+    hcs300->dup_stats.forwarded++;
+    return true;
+  }
+
+  // Rolling codes change with every press, fixed codes are told apart by the
+  // pause between the presses (the tick counter wraps around)
+  for (uint8_t entry_idx = 0; entry_idx < HCS300_DUP_CACHE_SIZE; entry_idx++) {
+    hcs300_dup_entry_t *candidate = &hcs300->dup_cache[entry_idx];
+
+    if (!candidate->valid
+        || now_ticks - candidate->last_seen_ticks > hcs300->dup_window_ticks) {
+      candidate->valid = false;
+    } else if (candidate->protocol == protocol
+               && candidate->serial == packet->serial
+               && candidate->encrypted == packet->encrypted
+               && candidate->btn_status == btn_status) {
+      entry = candidate;
+    }
+
+    if (!candidate->valid
+        || (oldest->valid
+            && now_ticks - candidate->last_seen_ticks > now_ticks - oldest->last_seen_ticks)) {
+      oldest = candidate;
+    }
+  }
+
+  if (entry == NULL) {
+    entry = oldest;
+    entry->protocol = protocol;
+    entry->serial = packet->serial;
+    entry->encrypted = packet->encrypted;
+    entry->btn_status = btn_status;
+    entry->first_seen_ticks = now_ticks;
+    entry->repeat_cnt = 0;
+    entry->valid = true;
+  } else if (entry->repeat_cnt < UINT16_MAX) {
+    entry->repeat_cnt++;
+  }
+  entry->last_seen_ticks = now_ticks;
+  hcs300->last_frame_info.repeat_count = entry->repeat_cnt;
+
+  forward = entry->repeat_cnt == 0
+            || (hcs300->config->dup_policy == HCS300_DUP_POLICY_FORWARD_EVERY_NTH
+                && entry->repeat_cnt % hcs300->config->dup_forward_every == 0);
+  if (forward) {
+    hcs300->dup_stats.forwarded++;
+  } else {
+    hcs300->dup_stats.suppressed++;
+    app_log_debug("HCS300 repeat %u suppressed, %lu ms since the first frame" APP_LOG_NL,
+                  entry->repeat_cnt,
+                  sl_sleeptimer_tick_to_ms(now_ticks - entry->first_seen_ticks));
+  }
+
+  return forward;
+}
+
+sl_status_t hcs300_create_codeword(uint16_t hcs300_id,
+                                   const hcs300_protocol_t *protocol,
+                                   uint8_t *codeword,
+                                   uint16_t *codeword_len,
+                                   bool rpt,
+                                   bool vlow,
+                                   uint8_t btn_status,
+                                   uint32_t serial,
+                                   uint32_t encrypted,
+                                   uint8_t trailer)
+{
+  (void) hcs300_id;
+  if (protocol == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  return create_codeword(hcs300,
+                         protocol,
+                         codeword,
+                         codeword_len,
+                         rpt,
+                         vlow,
+                         btn_status,
+                         serial,
+                         encrypted,
+                         trailer,
+                         true,  // Preamble
+                         true,  // Header
+                         false); // Guard time
+}
+
+sl_status_t hcs300_create_codeword_data(uint16_t hcs300_id,
+                                        const hcs300_protocol_t *protocol,
+                                        uint8_t *codeword,
+                                        uint16_t *codeword_len,
+                                        bool rpt,
+                                        bool vlow,
+                                        uint8_t btn_status,
+                                        uint32_t serial,
+                                        uint32_t encrypted,
+                                        uint8_t trailer)
+{
+  (void) hcs300_id;
+  if (protocol == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  // The PHY sends the KEELOQ preamble and header only, fixed-code protocols
+  // keep their sync
+  return create_codeword(hcs300,
+                         protocol,
+                         codeword,
+                         codeword_len,
+                         rpt,
+                         vlow,
+                         btn_status,
+                         serial,
+                         encrypted,
+                         trailer,
+                         protocol->preamble_te == 0,  // Preamble
+                         protocol->preamble_te == 0,  // Header
+                         true); // Guard time
+}
+
+sl_status_t hcs300_create_frame(uint16_t hcs300_id,
+                                const hcs300_protocol_t *protocol,
+                                uint8_t *codeword,
+                                uint16_t *codeword_len,
+                                bool rpt,
+                                bool vlow,
+                                uint8_t btn_status,
+                                uint32_t serial,
+                                uint32_t encrypted,
+                                uint8_t trailer)
+{
+  (void) hcs300_id;
+  if (protocol == NULL) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  return create_codeword(hcs300,
+                         protocol,
+                         codeword,
+                         codeword_len,
+                         rpt,
+                         vlow,
+                         btn_status,
+                         serial,
+                         encrypted,
+                         trailer,
+                         true,  // Preamble
+                         true,  // Header
+                         true); // Guard time
+}
+
+static void init_gpio(void)
+{
+  // Configure PD2 pin as input with the pull-up and filter enabled
+  sl_hal_gpio_set_pin_mode(&hcs300->config->pwm_pin,
+                           SL_GPIO_MODE_INPUT_PULL_FILTER,
+                           0);
+
+  // Configure S0 pin as output and set it to low (no operation)
+  sl_hal_gpio_set_pin_mode(&hcs300->config->s0_pin,
+                           SL_GPIO_MODE_PUSH_PULL,
+                           0);
+}
+
+static void init_timer(void)
+{
+  TIMER_TypeDef *timer = hcs300->config->timer;
+  bool free_running = hcs300->config->timebase == HCS300_TIMEBASE_FREE_RUNNING;
+
+  // Configure TIMER0 in input capture mode
+  sl_hal_timer_config_t timer_config = SL_HAL_TIMER_INIT_DEFAULT;
+  if (!free_running) {
+    timer_config.input_rise_action = SL_HAL_TIMER_INPUT_ACTION_RELOAD_START;
+    timer_config.input_fall_action = SL_HAL_TIMER_INPUT_ACTION_RELOAD_START;
+  }
+
+  // Configure channel for input capture
+  sl_hal_timer_channel_config_t chn_config_0 = SL_HAL_TIMER_CHANNEL_INIT_DEFAULT;
+
+  // Select capture mode for channel 0
+  chn_config_0.channel_mode = SL_HAL_TIMER_CHANNEL_MODE_CAPTURE;
+  chn_config_0.input_type = SL_HAL_TIMER_CHANNEL_INPUT_PIN;
+  chn_config_0.input_capture_edge = SL_HAL_TIMER_CHANNEL_EDGE_BOTH;
+  chn_config_0.input_capture_event = SL_HAL_TIMER_CHANNEL_EVENT_EVERY_EDGE;
+  chn_config_0.filter = true;
+
+  // Route the PD2 pin to TIMER0 capture/compare channel 0 and enable
+  // On Series 2, routing must be done after channel initialization
+  GPIO->TIMERROUTE[0].CC0ROUTE = (hcs300->config->pwm_pin.port << _GPIO_TIMER_CC0ROUTE_PORT_SHIFT)
+                                 | (hcs300->config->pwm_pin.pin << _GPIO_TIMER_CC0ROUTE_PIN_SHIFT);
+  GPIO->TIMERROUTE[0].ROUTEEN  = GPIO_TIMER_ROUTEEN_CC0PEN;
+
+  // Initialize channel configuration (this also disables the timer temporarily)
+  sl_hal_timer_channel_init(timer, 0, &chn_config_0);
+
+  // Initialize timer (this disables the timer temporarily)
+  sl_hal_timer_init(timer, &timer_config);
+
+  if (hcs300->early_end_of_frame || free_running) {
+    // Channel 1 compare fires when the line has been idle for a few TE since
+    // the last edge (the counter is reloaded on every edge). It happens at
+    // the header gap and after the last data bit, the guard time overflow is
+    // kept as fallback for malformed frames.
+    // With the free-running timebase the compare value is re-armed after each
+    // capture, it also replaces the guard time overflow.
+    sl_hal_timer_channel_config_t chn_config_1 = SL_HAL_TIMER_CHANNEL_INIT_DEFAULT;
+    chn_config_1.channel_mode = SL_HAL_TIMER_CHANNEL_MODE_COMPARE;
+    sl_hal_timer_channel_init(timer, 1, &chn_config_1);
+  }
+
+  // Enable interrupts
+  sl_hal_timer_enable_interrupts(timer, TIMER_IEN_OF);
+  if (hcs300->early_end_of_frame || free_running) {
+    sl_hal_timer_enable_interrupts(timer, TIMER_IEN_CC1);
+  }
+  if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_IRQ) {
+    // In DMA mode the capture FIFO is drained by LDMA
+    sl_hal_timer_enable_interrupts(timer, TIMER_IEN_CC0);
+  } else if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_IRQ_BATCHED) {
+    sl_hal_timer_enable_interrupts(timer, TIMER_IEN_ICFWLFULL0);
+  }
+  sl_interrupt_manager_enable_irq(TIMER0_IRQn);
+
+  // Finally enable the timer
+  sl_hal_timer_enable(timer);
+
+  if (free_running) {
+    // Full range, the overflow only extends the timestamps
+    sl_hal_timer_set_top(timer, HCS300_TIMER_MAX_COUNT);
+    hcs300->end_of_frame_deadline = 0;
+    sl_hal_timer_channel_set_compare(timer, 1, 0);
+    sl_hal_timer_start(timer);
+    return;
+  }
+
+  // Set guard time as top value
+  uint32_t guard_time_ticks = us_to_ticks(hcs300->config->guard_time_us);
+  sl_hal_timer_set_top(timer, guard_time_ticks);
+
+  update_idle_compare();
+}
+
+#if HCS300_DMA_CAPTURE_ENABLE
+static sl_status_t init_dma(void)
+{
+  TIMER_TypeDef *timer = hcs300->config->timer;
+  bool streaming = hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING;
+  Ecode_t ecode;
+
+  ecode = DMADRV_AllocateChannel(&hcs300->dma_channel, NULL);
+  if (ecode != ECODE_EMDRV_DMADRV_OK) {
+    return SL_STATUS_NO_MORE_RESOURCE;
+  }
+
+  // Each CC0 capture requests a single word transfer from the capture FIFO.
+  LDMA_TransferCfg_t transfer_config =
+    LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_TIMER0_CC0);
+
+  if (streaming) {
+    // Two descriptors filling the two halves of the ring linked to each
+    // other. The decoder is fed from the interrupt of each completed half.
+    hcs300->dma_descriptors[0] = (LDMA_Descriptor_t)
+      LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&timer->CC[0].ICF,
+                                       &hcs300->dma_ring[0],
+                                       HCS300_DMA_RING_LEN / 2,
+                                       1);
+    hcs300->dma_descriptors[1] = (LDMA_Descriptor_t)
+      LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&timer->CC[0].ICF,
+                                       &hcs300->dma_ring[HCS300_DMA_RING_LEN / 2],
+                                       HCS300_DMA_RING_LEN / 2,
+                                       -1);
+  } else {
+    // The descriptor links to itself so the ring is refilled from the beginning
+    // when the end is reached and the transfer never completes.
+    hcs300->dma_descriptors[0] = (LDMA_Descriptor_t)
+      LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&timer->CC[0].ICF,
+                                       hcs300->dma_ring,
+                                       HCS300_DMA_RING_LEN,
+                                       0);
+    hcs300->dma_descriptors[0].xfer.doneIfs = 0;
+  }
+  hcs300->dma_ring_tail = 0;
+
+  ecode = DMADRV_LdmaStartTransfer((int) hcs300->dma_channel,
+                                   &transfer_config,
+                                   &hcs300->dma_descriptors[0],
+                                   streaming ? dma_block_cb : NULL,
+                                   NULL);
+  if (ecode != ECODE_EMDRV_DMADRV_OK) {
+    (void) DMADRV_FreeChannel(hcs300->dma_channel);
+    return SL_STATUS_FAIL;
+  }
+
+  return SL_STATUS_OK;
+}
+
+static bool dma_block_cb(unsigned int channel,
+                         unsigned int sequence_no,
+                         void *user_param)
+{
+  (void) channel;
+  (void) sequence_no;
+  (void) user_param;
+
+  hcs300->irq_count++;
+
+  // Half of the ring has been filled, feed the decoder in the meantime
+  drain_dma_ring();
+
+  return true;
+}
+
+static void drain_dma_ring(void)
+{
+  CORE_DECLARE_IRQ_STATE;
+
+  // Called from both the LDMA and the TIMER0 interrupt
+  CORE_ENTER_ATOMIC();
+
+  // The current destination address of the channel is the write position,
+  // it is valid regardless of which descriptor of the ring is active.
+  uint32_t dst = LDMA->CH[hcs300->dma_channel].DST;
+  uint16_t head = ((dst - (uint32_t)(uintptr_t) hcs300->dma_ring) / sizeof(hcs300->dma_ring[0]))
+                  & (HCS300_DMA_RING_LEN - 1);
+  uint16_t tail = hcs300->dma_ring_tail;
+
+  // More captures than the ring length can't be detected here, but such a
+  // codeword would overflow the captures array anyway and the decoding fails.
+  while (tail != head) {
+    on_capture(hcs300->dma_ring[tail]);
+    tail = (tail + 1) & (HCS300_DMA_RING_LEN - 1);
+  }
+
+  hcs300->dma_ring_tail = head;
+
+  CORE_EXIT_ATOMIC();
+}
+#endif
+
+static void on_capture(uint32_t capture)
+{
+  if (hcs300->capture_idx != 0 && is_frame_gap(capture)) {
+    // This edge starts the next frame of a repeat burst
+    split_frame();
+    capture = 0;
+  }
+
+  if (hcs300->capture_idx != 0) {
+    detect_frame_te(capture);
+  }
+
+  hcs300->frame_stats.irq_count = (uint16_t)(hcs300->irq_count - hcs300->frame_irq_start);
+
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING) {
+    // The first capture is always zero, it only marks the start of frame
+    uint32_t level;
+    if (hcs300->capture_idx++ != 0
+        && hcs300_glitch_filter_feed(&hcs300->stream_filter, capture, &level)) {
+      feed_stream_decoder(level);
+    }
+    return;
+  }
+
+#if HCS300_CAPTURE_BUFFER_ENABLE
+  hcs300_frame_t *frame = acquire_frame();
+
+  // The capture_idx is non-negative here
+  if (frame != NULL && hcs300->capture_idx < ARRAY_SIZE(frame->captures)) {
+    frame->captures[hcs300->capture_idx++] = capture;
+  } else {
+    hcs300->capture_idx++;
+  }
+#endif
+}
+
+static void on_timestamp(TIMER_TypeDef *timer, uint32_t capture)
+{
+  uint64_t timestamp = extend_timestamp(timer, capture);
+  uint32_t duration = 0;
+
+  if (hcs300->capture_idx != 0) {
+    duration = (uint32_t)(timestamp - hcs300->frame_stats.end_ticks);
+    if (is_frame_gap(duration)) {
+      // Split before the timing is updated, the frame ends at its last edge
+      split_frame();
+    }
+  }
+
+  if (hcs300->capture_idx == 0) {
+    // First edge, the duration is zero the same way as with reload timebase
+    hcs300->frame_stats.start_ticks = timestamp;
+    hcs300->frame_stats.gap_ticks = (hcs300->prev_frame_end_ticks != 0)
+                                     ? timestamp - hcs300->prev_frame_end_ticks
+                                     : 0;
+    duration = 0;
   }
+  hcs300->frame_stats.end_ticks = timestamp;
 
-  hcs300->te_nominal_ticks = us_to_ticks(hcs300->config->te_nominal_us);
+  on_capture(duration);
+}
 
-  init_gpio();
-  init_timer();
+static uint16_t drain_capture_fifo(TIMER_TypeDef *timer)
+{
+  uint16_t capture_cnt = 0;
 
-  #ifdef SL_CATALOG_POWER_MANAGER_PRESENT
-  sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
-  #endif
+  while ((sl_hal_timer_get_status(timer) & TIMER_STATUS_ICFEMPTY0) == 0) {
+    uint32_t capture = sl_hal_timer_channel_get_capture(timer, 0);
+    if (hcs300->config->timebase == HCS300_TIMEBASE_FREE_RUNNING) {
+      on_timestamp(timer, capture);
+    } else {
+      on_capture(capture);
+    }
+    capture_cnt++;
+  }
 
-  return SL_STATUS_OK;
+  return capture_cnt;
 }
 
-sl_status_t hcs300_deinit(void)
+static uint64_t extend_timestamp(TIMER_TypeDef *timer, uint32_t capture)
 {
-  // TODO
-  return SL_STATUS_NOT_SUPPORTED;
+  uint32_t overflows = hcs300->timer_overflows;
+
+  // The overflow may be pending while the capture or counter value is already
+  // taken after it. Values are read shortly after the event, so a small value
+  // with pending overflow belongs to the next period.
+  if ((sl_hal_timer_get_pending_interrupts(timer) & TIMER_IF_OF)
+      && capture < HCS300_TIMER_MAX_COUNT / 2) {
+    overflows++;
+  }
+
+  return ((uint64_t) overflows << 32) | capture;
 }
 
-void hcs300_step(void)
+static void arm_end_of_frame(TIMER_TypeDef *timer, bool guard)
 {
-  sl_status_t sc;
+  uint32_t timeout_ticks;
 
-  if (hcs300->capture_len != 0) {
-    hcs300_decoder_t decoder;
-    memset(&decoder, 0, sizeof(decoder));
-
-    // TODO: Add function
-    if (hcs300->capture_len > ARRAY_SIZE(hcs300->captures)) {
-      app_log_error("HCS300 capture buffer overflow (%u/%u)" APP_LOG_NL,
-                    hcs300->capture_len,
-                    (unsigned)ARRAY_SIZE(hcs300->captures));
-      hcs300->capture_len = 0;
-      return;
-    }
-
-    // Skip the first capture which is always zero
-    decoder.capture_idx = 1;
-
-    app_log_debug("HCS300 captures: ");
-    app_log_array_dump_debug(hcs300->captures, hcs300->capture_len, "%lu");
-    app_log_nl();
+  if (guard) {
+    timeout_ticks = us_to_ticks(hcs300->config->guard_time_us);
+  } else {
+    timeout_ticks = hcs300->end_of_frame_idle_ticks;
+  }
 
-    sc = process_preamble_header(hcs300, &decoder);
+  // The counter wraps around, so does the compare value
+  hcs300->end_of_frame_deadline = (uint32_t) hcs300->frame_stats.end_ticks + timeout_ticks;
+  hcs300->end_of_frame_guard = guard;
+  sl_hal_timer_channel_set_compare(timer, 1, hcs300->end_of_frame_deadline);
+}
 
-    if (sc != SL_STATUS_OK) {
-      hcs300->capture_len = 0;
-      return;
-    }
+static void on_end_of_frame_deadline(TIMER_TypeDef *timer)
+{
+  // Compare matches without frame (the counter wrapped around) or matches of
+  // a deadline that has been moved by a capture meanwhile are ignored.
+  if (hcs300->capture_idx == 0
+      || (int32_t)(sl_hal_timer_get_counter(timer) - hcs300->end_of_frame_deadline) < 0) {
+    return;
+  }
 
-    sc = process_data(hcs300, &decoder);
-    hcs300->capture_len = 0;
-
-    if (sc == SL_STATUS_OK) {
-        app_log_info("HCS300 packet received: "
-                    "RPT=%u VLOW=%u S0=%u S1=%u S2=%u S3=%u "
-                    "SERIAL=0x%08lX ENC=0x%08lX" APP_LOG_NL,
-                    decoder.data.rpt,
-                    decoder.data.vlow,
-                    decoder.data.s0,
-                    decoder.data.s1,
-                    decoder.data.s2,
-                    decoder.data.s3,
-                    (uint32_t) decoder.data.serial,
-                    decoder.data.encrypted);
-
-        uint8_t btn_status = decoder.data.s0
-                          | (decoder.data.s1 << 1)
-                          | (decoder.data.s2 << 2)
-                          | (decoder.data.s3 << 3);
-        hcs300_on_rx_packet(0, // TODO: HCS300 ID
-                            decoder.data.rpt,
-                            decoder.data.vlow,
-                            btn_status,
-                            decoder.data.serial,
-                            decoder.data.encrypted);
-    }
+  if (!hcs300->end_of_frame_guard && !is_frame_complete()) {
+    // Idle period inside the frame (header gap), wait for the guard time
+    hcs300->idle_capture_idx = hcs300->capture_idx;
+    arm_end_of_frame(timer, true);
+    return;
   }
+
+  end_frame(timer);
 }
 
-sl_status_t hcs300_create_codeword(uint16_t hcs300_id,
-                                   uint8_t *codeword,
-                                   uint16_t *codeword_len,
-                                   bool rpt,
-                                   bool vlow,
-                                   uint8_t btn_status,
-                                   uint32_t serial,
-                                   uint32_t encrypted)
+static bool is_frame_gap(uint32_t duration)
 {
-  (void) hcs300_id;
-  return create_codeword(hcs300,
-                         codeword,
-                         codeword_len,
-                         rpt,
-                         vlow,
-                         btn_status,
-                         serial,
-                         encrypted,
-                         hcs300->te_nominal_ticks,
-                         true,  // Preamble
-                         true,  // Header
-                         false); // Guard time
+  // No level of a frame is longer than the header gap, a longer one is the
+  // guard time between repeated frames that didn't last long enough to end
+  // the frame by the timer (guard time overflow or deadline).
+  return hcs300->frame_split_ticks != 0 && duration >= hcs300->frame_split_ticks;
 }
 
-sl_status_t hcs300_create_codeword_data(uint16_t hcs300_id,
-                                        uint8_t *codeword,
-                                        uint16_t *codeword_len,
-                                        bool rpt,
-                                        bool vlow,
-                                        uint8_t btn_status,
-                                        uint32_t serial,
-                                        uint32_t encrypted)
+static void reset_frame_te(void)
 {
-  (void) hcs300_id;
-  return create_codeword(hcs300,
-                         codeword,
-                         codeword_len,
-                         rpt,
-                         vlow,
-                         btn_status,
-                         serial,
-                         encrypted,
-                         hcs300->te_nominal_ticks,
-                         false,  // Preamble
-                         false,  // Header
-                         false); // Guard time
+  hcs300->te_detect_sum = 0;
+  hcs300->te_detect_cnt = 0;
+
+  if (hcs300->config->te_nominal_us != 0) {
+    hcs300->frame_stats.te_nominal_ticks = hcs300->te_nominal_ticks;
+    set_frame_te(hcs300->te_nominal_ticks, hcs300->te_nominal_ticks);
+  } else {
+    hcs300->frame_stats.te_nominal_ticks = 0;
+    set_frame_te(hcs300->te_class_ticks[HCS300_TE_CLASS_100US],
+                 hcs300->te_class_ticks[HCS300_TE_CLASS_400US]);
+  }
 }
 
-static sl_status_t process_preamble_header(hcs300_t *hcs300,
-                                           hcs300_decoder_t *decoder)
+static void detect_frame_te(uint32_t duration)
 {
-  uint32_t pulse_width = 0;
+  hcs300_te_class_t te_class;
 
-  while (decoder->capture_idx < hcs300->capture_len) {
-    // Each pulse in preamble should be about 23 TE (50% duty cycle)
-    pulse_width = hcs300->captures[decoder->capture_idx];
+  // The first preamble levels are averaged, spikes are left out
+  if (hcs300->config->te_nominal_us != 0
+      || hcs300->te_detect_cnt >= HCS300_TE_DETECT_LEVELS
+      || duration < hcs300->frame_stats.glitch_min_ticks) {
+    return;
+  }
 
-    if (decoder->capture_idx >= 2 *hcs300->config->min_preamble_pulses) {
-      if (is_within_rel_tolerance(pulse_width,
-                                  HCS300_HEADER_GAP_TE * decoder->te_ticks,
-                                  hcs300->config->te_tolerance_prec_pct)) {
-        decoder->capture_idx++;
-        // The header is zero and the codeword array is already cleared so
-        // continue with data decoding
-        break;
-      }
-    }
+  hcs300->te_detect_sum += duration;
+  if (++hcs300->te_detect_cnt < HCS300_TE_DETECT_LEVELS) {
+    return;
+  }
 
-    decoder->te_ticks_sum += pulse_width;
-    decoder->preamble_capture_cnt++;
-    decoder->te_ticks = decoder->te_ticks_sum / decoder->preamble_capture_cnt;
-    decoder->capture_idx++;
+  te_class = hcs300_te_classify(hcs300->te_detect_sum / HCS300_TE_DETECT_LEVELS,
+                                hcs300->te_class_ticks[HCS300_TE_CLASS_100US]);
+  if (te_class == HCS300_TE_CLASS_INVALID) {
+    // Not a HCS300 preamble, the decoder rejects it anyway
+    return;
   }
 
-  app_log_debug("HCS300 preamble detected (%u pulses)" APP_LOG_NL,
-                (decoder->preamble_capture_cnt + 1) / 2);
-  app_log_debug("HCS300 measured TE average: %lu us" APP_LOG_NL,
-                ticks_to_us(decoder->te_ticks));
-  app_log_debug("HCS300 header detected (%lu us)" APP_LOG_NL,
-                ticks_to_us(pulse_width));
+  hcs300->frame_stats.te_nominal_ticks = hcs300->te_class_ticks[te_class];
+  set_frame_te(hcs300->frame_stats.te_nominal_ticks, hcs300->frame_stats.te_nominal_ticks);
+  // Only the levels after the preamble are affected, they are still pending
+  hcs300->stream_filter.min_ticks = hcs300->frame_stats.glitch_min_ticks;
+  update_idle_compare();
+}
 
-  return SL_STATUS_OK;
+static void set_frame_te(uint32_t glitch_te_ticks, uint32_t gap_te_ticks)
+{
+  hcs300->frame_stats.glitch_min_ticks = SL_MAX(hcs300->glitch_min_us_ticks,
+                                                hcs300->config->glitch_min_te_pct
+                                                * glitch_te_ticks / 100);
+  hcs300->frame_split_ticks = hcs300->config->frame_split_gap_te * gap_te_ticks;
+  hcs300->end_of_frame_idle_ticks = hcs300->config->end_of_frame_idle_te * gap_te_ticks;
 }
 
-static sl_status_t decode_next_pwm(hcs300_t *hcs300, hcs300_decoder_t *decoder, uint8_t *bit)
+static void update_idle_compare(void)
 {
-  if (decoder->capture_idx + 1 >= hcs300->capture_len) {
-    return SL_STATUS_INVALID_COUNT;
+  // With the free-running timebase the compare value is armed by every capture
+  if (hcs300->early_end_of_frame
+      && hcs300->config->timebase == HCS300_TIMEBASE_RELOAD) {
+    sl_hal_timer_channel_set_compare(hcs300->config->timer,
+                                     1,
+                                     hcs300->end_of_frame_idle_ticks);
   }
+}
 
-  uint32_t high_duration = hcs300->captures[decoder->capture_idx];
-  uint32_t low_duration  = hcs300->captures[decoder->capture_idx + 1];
+static void split_frame(void)
+{
+  on_end_of_frame();
+  // The current interrupt belongs to the new frame
+  hcs300->frame_irq_start = hcs300->irq_count - 1;
+  hcs300->split_frames++;
+  hcs300_proceed_cb();
+}
 
-  if (is_within_rel_tolerance(high_duration,
-                              2 * decoder->te_ticks,
-                              hcs300->config->te_tolerance_prec_pct)
-      && is_within_rel_tolerance(low_duration,
-                                 1 * decoder->te_ticks,
-                                 hcs300->config->te_tolerance_prec_pct)) {
-    // Detected a '0' bit
-    *bit = 0;
-  } else if (is_within_rel_tolerance(high_duration,
-                                     1 * decoder->te_ticks,
-                                     hcs300->config->te_tolerance_prec_pct)
-             && is_within_rel_tolerance(low_duration,
-                                        2 * decoder->te_ticks,
-                                        hcs300->config->te_tolerance_prec_pct)) {
-    // Detected a '1' bit
-    *bit = 1;
-  } else {
-    return SL_STATUS_INVALID_RANGE;
+static void reset_stream_decoders(void)
+{
+  for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+    hcs300_decoder_reset(&hcs300->stream_decoders[protocol_idx], &hcs300->config->decoder);
+    (void) hcs300_decoder_set_protocol(&hcs300->stream_decoders[protocol_idx],
+                                       hcs300->config->protocols[protocol_idx]);
   }
+  hcs300->stream_matched = false;
 
-  decoder->capture_idx += 2;
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING) {
+    record_history(&hcs300->stream_decoders[0]);
+  }
+}
 
-  return SL_STATUS_OK;
+static void feed_stream_decoder(uint32_t duration)
+{
+  bool completed = false;
+
+  for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+    hcs300_decoder_t *decoder = &hcs300->stream_decoders[protocol_idx];
+    bool soft_complete = hcs300_decoder_is_soft_complete(decoder);
+
+    (void) hcs300_decoder_feed(decoder, duration);
+    // Only the level of the last data bit completes the frame
+    completed |= !soft_complete && hcs300_decoder_is_soft_complete(decoder);
+  }
+
+  if (completed && !is_stream_decoding()) {
+    publish_stream_match();
+  }
 }
 
-static sl_status_t store_data_bit(hcs300_decoder_t *decoder, uint8_t bit)
+static bool is_stream_decoding(void)
 {
-  // Data portion of code word - which starts after header - has the following structure: (66 bits)
-  // Note: multiple bits are sent in LSB first order
-  //   - Encrypted data: 32 bits
-  //   - Serial number: 28 bits
-  //   - Button code: 4 bits (s3,s0,s1,s2)
-  //   - VLOW: 1 bit
-  //   - RPT: 1 bit
+  for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+    hcs300_decoder_state_t state = hcs300->stream_decoders[protocol_idx].state;
 
-  if (decoder->data_bit_idx < HCS300_SERIAL_NUM_OFFSET) {
-    decoder->data.encrypted >>= 1;
-    if (bit) {
-      decoder->data.encrypted |= 0x80000000;
+    if (state != HCS300_DECODER_STATE_DONE && state != HCS300_DECODER_STATE_ERROR) {
+      return true;
     }
-  } else if (decoder->data_bit_idx < HCS300_BUTTON_CODE_OFFSET) {
-    decoder->data.serial >>= 1;
-    if (bit) {
-      decoder->data.serial |= 0x08000000;
-    }
-  } else if (decoder->data_bit_idx < HCS300_VLOW_OFFSET) {
-    // Button code bits
-    if (decoder->data_bit_idx == HCS300_BUTTON_CODE_OFFSET) {
-      decoder->data.s3 = bit;
-    } else if (decoder->data_bit_idx == HCS300_BUTTON_CODE_OFFSET + 1) {
-      decoder->data.s0 = bit;
-    } else if (decoder->data_bit_idx == HCS300_BUTTON_CODE_OFFSET + 2) {
-      decoder->data.s1 = bit;
-    } else if (decoder->data_bit_idx == HCS300_BUTTON_CODE_OFFSET + 3) {
-      decoder->data.s2 = bit;
+  }
+  return false;
+}
+
+static void publish_stream_match(void)
+{
+  // A frame completing a shorter protocol may go on with a longer one, the
+  // packet is published once no other decoder is in progress (or at the end
+  // of frame) for the first protocol that is done
+  for (uint8_t protocol_idx = 0;
+       protocol_idx < hcs300->config->protocol_cnt && !hcs300->stream_matched;
+       protocol_idx++) {
+    const hcs300_decoder_t *decoder = &hcs300->stream_decoders[protocol_idx];
+
+    if (decoder->state == HCS300_DECODER_STATE_DONE) {
+      hcs300->stream_matched = publish_stream_packet(decoder, decoder->status);
     }
-  } else if (decoder->data_bit_idx == HCS300_VLOW_OFFSET) {
-    decoder->data.vlow = bit;
-  } else if (decoder->data_bit_idx == HCS300_RPT_OFFSET) {
-    decoder->data.rpt = bit;
-  } else {
-    // Should not happen
-    return SL_STATUS_INVALID_RANGE;
   }
-  decoder->data_bit_idx++;
+}
 
-  return SL_STATUS_OK;
+static bool publish_stream_packet(const hcs300_decoder_t *decoder,
+                                  sl_status_t sc)
+{
+  hcs300_packet_t packet;
+
+  // The last data bit has arrived, no need to wait for the guard time
+  hcs300->frame_stats.glitch_cnt = hcs300->stream_filter.glitch_cnt;
+  hcs300->frame_stats.te_ticks = decoder->te_ticks;
+  hcs300->frame_stats.te_drift_ppm = hcs300_decoder_te_drift_ppm(decoder);
+  hcs300->frame_stats.te_tolerance_pct = decoder->tolerance_pct;
+  hcs300->frame_stats.sync = decoder->sync;
+  hcs300->frame_stats.protocol = decoder->protocol;
+
+  if (sc == SL_STATUS_OK) {
+    (void) combine_frame(decoder, true, NULL);
+    hcs300->frame_stats.combined_frames = 0;
+    publish_packet(&decoder->data, &hcs300->frame_stats);
+    return true;
+  }
+
+  hcs300->frame_stats.combined_frames = combine_frame(decoder, false, &packet);
+  if (hcs300->frame_stats.combined_frames == 0) {
+    return false;
+  }
+
+  publish_packet(&packet, &hcs300->frame_stats);
+  return true;
 }
 
-static sl_status_t process_data(hcs300_t *hcs300,
-                                hcs300_decoder_t *decoder)
+static void flush_stream_filter(void)
 {
-  if (hcs300->capture_len >= ARRAY_SIZE(hcs300->captures)) {
-    // Each bit is 3 TE, 1 or 2 TE low at the end is missing because the guard
-    // time follows with low level so there isn't any edge to capture it.
-    // Space is reserved for this last 1 or 2 TE low duration to ease processing.
-    // This means the captures array can't be completely full.
-    return SL_STATUS_INVALID_COUNT;
+  uint32_t level;
+
+  if (hcs300_glitch_filter_flush(&hcs300->stream_filter, &level)) {
+    feed_stream_decoder(level);
   }
+}
 
-  // Add last fake capture value for easier processing.
-  uint32_t last_capture = hcs300->captures[hcs300->capture_len - 1];
-  if (is_within_rel_tolerance(last_capture,
-                              decoder->te_ticks,
-                              hcs300->config->te_tolerance_prec_pct)) {
-    hcs300->captures[hcs300->capture_len] = 2 * decoder->te_ticks;
-  } else {
-    hcs300->captures[hcs300->capture_len] = decoder->te_ticks;
+static bool is_frame_complete(void)
+{
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING) {
+    // The line is idle, the level held back by the glitch filter can't be
+    // followed by a spike anymore
+    flush_stream_filter();
+    for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+      if (hcs300->stream_decoders[protocol_idx].state == HCS300_DECODER_STATE_DONE) {
+        return true;
+      }
+    }
+    return false;
   }
-  hcs300->capture_len++;
 
-  if (hcs300->capture_len - decoder->capture_idx != HCS300_DATA_BITS_CAPTURES) {
-    return SL_STATUS_INVALID_COUNT;
+  // The previous idle period is the header gap, every data capture has
+  // arrived since then (the header capture included, the last low is not).
+  // The data levels don't have idle periods, a shorter protocol can't end
+  // the frame of a longer one.
+  for (uint8_t protocol_idx = 0; protocol_idx < hcs300->config->protocol_cnt; protocol_idx++) {
+    const hcs300_protocol_t *protocol = hcs300->config->protocols[protocol_idx];
+    uint16_t data_captures;
+
+    switch (protocol->encoding) {
+      case HCS300_BIT_ENCODING_VPWM:
+        // Every bit is a level, the last one is high
+        data_captures = 1 + protocol->data_bits;
+        break;
+      case HCS300_BIT_ENCODING_MANCHESTER:
+        // The level count depends on the data, the guard time ends the frame
+        continue;
+      default:
+        data_captures = 2 * protocol->data_bits;
+        break;
+    }
+    if ((uint16_t)(hcs300->capture_idx - hcs300->idle_capture_idx) == data_captures) {
+      return true;
+    }
   }
+  return false;
+}
 
-  // Each bit is represented by 2 captures (high and low)
-  while (decoder->capture_idx + 1 < hcs300->capture_len) {
-    uint8_t bit;
-    sl_status_t sc = decode_next_pwm(hcs300, decoder, &bit);
-    if (sc != SL_STATUS_OK) {
-      return sc;
+static void on_end_of_frame(void)
+{
+  hcs300->frame_stats.irq_count = (uint16_t)(hcs300->irq_count - hcs300->frame_irq_start);
+  hcs300->frame_irq_start = hcs300->irq_count;
+  hcs300->idle_capture_idx = 0;
+  hcs300->prev_frame_end_ticks = hcs300->frame_stats.end_ticks;
+
+  if (hcs300->config->decoder_mode == HCS300_DECODER_MODE_STREAMING) {
+    // Completed packets are published at the latest here, anything else is
+    // dropped
+    flush_stream_filter();
+    publish_stream_match();
+    // The first capture isn't a level
+    if (hcs300->capture_idx > hcs300->min_frame_levels) {
+      commit_history();
     }
+    hcs300->glitch_total += hcs300->stream_filter.glitch_cnt;
+    reset_frame_te();
+    update_idle_compare();
+    hcs300_glitch_filter_reset(&hcs300->stream_filter, hcs300->frame_stats.glitch_min_ticks);
+    reset_stream_decoders();
+    hcs300->capture_idx = 0;
+    return;
+  }
 
-    sc = store_data_bit(decoder, bit);
-    if (sc != SL_STATUS_OK) {
-      return sc;
+#if HCS300_CAPTURE_BUFFER_ENABLE
+  publish_frame();
+#endif
+  reset_frame_te();
+  update_idle_compare();
+}
+
+#if HCS300_CAPTURE_BUFFER_ENABLE
+static hcs300_frame_t *acquire_frame(void)
+{
+  // The slot of a frame is selected at its first capture and kept until the
+  // end of frame, otherwise a slot released in the middle of the frame would
+  // receive only the tail of the frame.
+  if (hcs300->capture_idx == 0) {
+    if ((uint8_t)(hcs300->frame_head - hcs300->frame_tail) < HCS300_FRAME_SLOTS) {
+      hcs300->capture_frame = &hcs300->frames[hcs300->frame_head & (HCS300_FRAME_SLOTS - 1)];
+    } else {
+      // Every slot is waiting for decoding, this frame is lost
+      hcs300->capture_frame = NULL;
     }
   }
 
-  return SL_STATUS_OK;
+  return hcs300->capture_frame;
 }
 
-static void init_gpio(void)
+static void publish_frame(void)
 {
-  // Configure PD2 pin as input with the pull-up and filter enabled
-  sl_hal_gpio_set_pin_mode(&hcs300->config->pwm_pin,
-                           SL_GPIO_MODE_INPUT_PULL_FILTER,
-                           0);
+  hcs300_frame_t *frame = hcs300->capture_frame;
 
-  // Configure S0 pin as output and set it to low (no operation)
-  sl_hal_gpio_set_pin_mode(&hcs300->config->s0_pin,
-                           SL_GPIO_MODE_PUSH_PULL,
-                           0);
+  if (hcs300->capture_idx == 0) {
+    // Nothing has been captured since the last frame
+    return;
+  }
+
+  if (frame != NULL) {
+    frame->capture_len = hcs300->capture_idx;
+    frame->stats = hcs300->frame_stats;
+    // Make sure the frame content is visible before handing over the slot
+    __DMB();
+    hcs300->frame_head++;
+  } else {
+    hcs300->dropped_frames++;
+  }
+
+  hcs300->capture_frame = NULL;
+  hcs300->capture_idx = 0;
 }
+#endif
 
-static void init_timer(void)
+static void publish_packet(const hcs300_packet_t *packet,
+                           const hcs300_frame_stats_t *stats)
 {
-  TIMER_TypeDef *timer = hcs300->config->timer;
+  if ((uint8_t)(hcs300->packet_head - hcs300->packet_tail) < HCS300_PACKET_SLOTS) {
+    hcs300_rx_packet_t *rx = &hcs300->packets[hcs300->packet_head & (HCS300_PACKET_SLOTS - 1)];
+    rx->packet = *packet;
+    rx->stats = *stats;
+    // Make sure the packet is visible before handing over the slot
+    __DMB();
+    hcs300->packet_head++;
+  } else {
+    hcs300->dropped_frames++;
+  }
 
-  // Configure TIMER0 in input capture mode
-  sl_hal_timer_config_t timer_config = SL_HAL_TIMER_INIT_DEFAULT;
-  timer_config.input_rise_action = SL_HAL_TIMER_INPUT_ACTION_RELOAD_START;
-  timer_config.input_fall_action = SL_HAL_TIMER_INPUT_ACTION_RELOAD_START;
+  hcs300_proceed_cb();
+}
 
-  // Configure channel for input capture
-  sl_hal_timer_channel_config_t chn_config_0 = SL_HAL_TIMER_CHANNEL_INIT_DEFAULT;
+static void end_frame(TIMER_TypeDef *timer)
+{
+  if (hcs300->config->timebase == HCS300_TIMEBASE_FREE_RUNNING) {
+    // The timer keeps running, captures left in the fifo are absolute
+    // timestamps of the next frame.
+    on_end_of_frame();
+    hcs300_proceed_cb();
+    return;
+  }
 
-  // Select capture mode for channel 0
-  chn_config_0.channel_mode = SL_HAL_TIMER_CHANNEL_MODE_CAPTURE;
-  chn_config_0.input_type = SL_HAL_TIMER_CHANNEL_INPUT_PIN;
-  chn_config_0.input_capture_edge = SL_HAL_TIMER_CHANNEL_EDGE_BOTH;
-  chn_config_0.input_capture_event = SL_HAL_TIMER_CHANNEL_EVENT_EVERY_EDGE;
-  chn_config_0.filter = true;
+  if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_DMA) {
+#if HCS300_DMA_CAPTURE_ENABLE
+    // LDMA has already moved every capture of the codeword into the ring
+    drain_dma_ring();
+#endif
+  } else if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_IRQ_BATCHED) {
+    // The last capture of the frame is still waiting for its pair
+    (void) drain_capture_fifo(timer);
+  } else {
+    while ((sl_hal_timer_get_status(timer) & TIMER_STATUS_ICFEMPTY0) == 0) {
+      // Make sure no captures are left in the fifo at the end of codeword because that could
+      // compromise the next reception.
+      (void) sl_hal_timer_channel_get_capture(timer, 0);
+    }
+  }
+  on_end_of_frame();
+  sl_hal_timer_stop(timer);
+  sl_hal_timer_set_counter(timer, 0);
+
+  if (hcs300->config->em2_idle) {
+    // Edges of the frame have set the flag even though the interrupt is disabled
+    sl_hal_gpio_clear_interrupts(1UL << hcs300->wakeup_int_no);
+    sl_gpio_enable_interrupts(1UL << hcs300->wakeup_int_no);
+    #ifdef SL_CATALOG_POWER_MANAGER_PRESENT
+    sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+    #endif
+  }
 
-  // Route the PD2 pin to TIMER0 capture/compare channel 0 and enable
-  // On Series 2, routing must be done after channel initialization
-  GPIO->TIMERROUTE[0].CC0ROUTE = (hcs300->config->pwm_pin.port << _GPIO_TIMER_CC0ROUTE_PORT_SHIFT)
-                                 | (hcs300->config->pwm_pin.pin << _GPIO_TIMER_CC0ROUTE_PIN_SHIFT);
-  GPIO->TIMERROUTE[0].ROUTEEN  = GPIO_TIMER_ROUTEEN_CC0PEN;
+  hcs300_proceed_cb();
+}
 
-  // Initialize channel configuration (this also disables the timer temporarily)
-  sl_hal_timer_channel_init(timer, 0, &chn_config_0);
+static sl_status_t init_wakeup(void)
+{
+  // GPIO edge interrupts of port A and B pins are asynchronous, they work in
+  // EM2 where TIMER0 is not clocked. The first rising edge of the preamble
+  // wakes up the device.
+  return sl_gpio_configure_external_interrupt(&hcs300->config->pwm_pin,
+                                              &hcs300->wakeup_int_no,
+                                              SL_GPIO_INTERRUPT_RISING_EDGE,
+                                              wakeup_cb,
+                                              NULL);
+}
 
-  // Initialize timer (this disables the timer temporarily)
-  sl_hal_timer_init(timer, &timer_config);
+static void wakeup_cb(uint8_t int_no, void *context)
+{
+  (void) context;
 
-  // Enable interrupts
-  sl_hal_timer_enable_interrupts(timer, TIMER_IEN_OF);
-  sl_hal_timer_enable_interrupts(timer, TIMER_IEN_CC0);
-  sl_interrupt_manager_enable_irq(TIMER0_IRQn);
+  // TIMER0 captures the rest of the frame, no need for an interrupt per edge
+  sl_gpio_disable_interrupts(1UL << int_no);
 
-  // Finally enable the timer
-  sl_hal_timer_enable(timer);
+  #ifdef SL_CATALOG_POWER_MANAGER_PRESENT
+  sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+  #endif
 
-  // Set guard time as top value
-  uint32_t guard_time_ticks = us_to_ticks(hcs300->config->guard_time_us);
-  sl_hal_timer_set_top(timer, guard_time_ticks);
+  // The edges lost while waking up are only a few preamble pulses. The timer
+  // is started here so the guard time overflow releases EM1 even if the
+  // wake-up was caused by noise. The first capture, which is normally zero,
+  // is the time since wake-up now and it is skipped the same way.
+  sl_hal_timer_start(hcs300->config->timer);
 }
 
 void TIMER0_IRQHandler(void)
 {
   TIMER_TypeDef *timer = hcs300->config->timer;
   uint32_t pending = sl_hal_timer_get_pending_interrupts(timer);
+  bool free_running = hcs300->config->timebase == HCS300_TIMEBASE_FREE_RUNNING;
+  bool batched = hcs300->config->capture_mode == HCS300_CAPTURE_MODE_IRQ_BATCHED;
+
+  hcs300->irq_count++;
+
+  if (pending & (TIMER_IF_CC0 | TIMER_IF_ICFWLFULL0)) {
+    // Clear interrupt flags
+    sl_hal_timer_clear_interrupts(timer, TIMER_IF_CC0 | TIMER_IF_ICFWLFULL0);
+
+    (void) drain_capture_fifo(timer);
 
-  if (pending & TIMER_IF_CC0) {
+    if (free_running) {
+      // Idle compare first if early end of frame is enabled, guard time otherwise
+      arm_end_of_frame(timer, !hcs300->early_end_of_frame);
+    }
+  }
+
+  if (pending & TIMER_IF_CC1) {
     // Clear interrupt flag
-    sl_hal_timer_clear_interrupts(timer, TIMER_IF_CC0);
+    sl_hal_timer_clear_interrupts(timer, TIMER_IF_CC1);
 
-    do {
-      uint32_t capture = sl_hal_timer_channel_get_capture(timer, 0);
+    if (free_running) {
+      if (batched && drain_capture_fifo(timer) != 0) {
+        // The deadline was armed before the last capture
+        arm_end_of_frame(timer, !hcs300->early_end_of_frame);
+      }
+      on_end_of_frame_deadline(timer);
+    } else {
+      if (hcs300->config->capture_mode == HCS300_CAPTURE_MODE_DMA) {
+#if HCS300_DMA_CAPTURE_ENABLE
+        // Bring the capture count up to date
+        drain_dma_ring();
+#endif
+      } else if (batched) {
+        (void) drain_capture_fifo(timer);
+      }
 
-      // The capture_idx is non-negative here
-      if (hcs300->capture_idx < ARRAY_SIZE(hcs300->captures)) {
-        hcs300->captures[hcs300->capture_idx++] = capture;
+      if (is_frame_complete()) {
+        // Only the trailing low of the last bit is left, don't wait for the guard time
+        end_frame(timer);
       } else {
-        hcs300->capture_idx++;
+        hcs300->idle_capture_idx = hcs300->capture_idx;
       }
-    } while ((sl_hal_timer_get_status(timer) & TIMER_STATUS_ICFEMPTY0) == 0);
+    }
   }
 
   if (pending & TIMER_IF_OF) {
-    hcs300->capture_len = hcs300->capture_idx;
-    hcs300->capture_idx = 0;
-    while ((sl_hal_timer_get_status(timer) & TIMER_STATUS_ICFEMPTY0) == 0) {
-      // Make sure no captures are left in the fifo at the end of codeword because that could
-      // compromise the next reception.
-      (void) sl_hal_timer_channel_get_capture(timer, 0);
+    if (free_running) {
+      // Clear first, extend_timestamp() relies on the pending flag
+      sl_hal_timer_clear_interrupts(timer, TIMER_IF_OF);
+      hcs300->timer_overflows++;
+    } else {
+      end_frame(timer);
+      // Clear interrupt flag
+      sl_hal_timer_clear_interrupts(timer, TIMER_IF_OF);
     }
-    sl_hal_timer_stop(timer);
-    sl_hal_timer_set_counter(timer, 0);
-    // Clear interrupt flag
-    sl_hal_timer_clear_interrupts(timer, TIMER_IF_OF);
-    hcs300_proceed_cb();
   }
 }
 
@@ -618,21 +2023,6 @@ SL_WEAK void hcs300_proceed_cb(void)
   // TODO
 }
 
-static bool is_within_tolerance(uint32_t value,
-                                uint32_t target,
-                                uint32_t tolerance)
-{
-  return (value >= (target - tolerance)) && (value <= (target + tolerance));
-}
-
-static bool is_within_rel_tolerance(uint32_t value,
-                                    uint32_t target,
-                                    uint8_t rel_tolerance_pct)
-{
-  uint32_t tolerance = (target * rel_tolerance_pct) / 100;
-  return is_within_tolerance(value, target, tolerance);
-}
-
 static uint32_t ticks_to_us(uint32_t ticks)
 {
   sl_status_t sc;
@@ -654,7 +2044,55 @@ static uint32_t us_to_ticks(uint32_t us)
   return (uint32_t)(((uint64_t) us * freq_hz + 500000U) / 1000000U);
 }
 
+static uint64_t ticks64_to_us(uint64_t ticks)
+{
+  sl_status_t sc;
+  uint32_t freq_hz = 0;
+  sc = sl_clock_manager_get_clock_branch_frequency(SL_CLOCK_BRANCH_EM01GRPCCLK,
+                                                   &freq_hz);
+  app_assert_status(sc);
+
+  // Split to avoid overflow of the multiplication with long timestamps
+  return (ticks / freq_hz) * 1000000U
+         + ((ticks % freq_hz) * 1000000U + freq_hz / 2) / freq_hz;
+}
+
+static void append_low_chips(uint8_t *codeword, uint16_t *cw_bit_idx, uint16_t chip_cnt)
+{
+  // Whole bytes are cleared, the chips after the run in its last byte are
+  // written by the next part
+  hcs300_chips_clear(codeword, *cw_bit_idx, (*cw_bit_idx + chip_cnt + 7) >> 3);
+  *cw_bit_idx += chip_cnt;
+}
+
+static void build_tx_template(uint16_t te_us)
+{
+  hcs300_tx_template_t *tx_template = &hcs300->tx_template;
+  uint16_t cw_bit_idx = 0;
+
+  tx_template->te_us = te_us;
+  tx_template->chips_per_te = 0;
+  tx_template->preamble_chips = 0;
+
+  if (te_us == 0 || te_us % hcs300->config->tx_chip_us != 0) {
+    // Packets with this TE can't be sent
+    return;
+  }
+  tx_template->chips_per_te = te_us / hcs300->config->tx_chip_us;
+
+  if (tx_template->chips_per_te > HCS300_TX_TEMPLATE_CHIPS_PER_TE) {
+    // The preamble is built a level at a time
+    return;
+  }
+  for (uint16_t te_idx = 0; te_idx < HCS300_PREAMBLE_TE; te_idx++) {
+    hcs300_chips_append_level(tx_template->preamble, &cw_bit_idx, tx_template->chips_per_te, (te_idx & 1) == 0);
+  }
+  hcs300_chips_clear(tx_template->preamble, cw_bit_idx, sizeof(tx_template->preamble));
+  tx_template->preamble_chips = cw_bit_idx;
+}
+
 static sl_status_t create_codeword(hcs300_t *hcs300,
+                                   const hcs300_protocol_t *protocol,
                                    uint8_t *codeword,
                                    uint16_t *codeword_len,
                                    bool rpt,
@@ -662,95 +2100,98 @@ static sl_status_t create_codeword(hcs300_t *hcs300,
                                    uint8_t btn_status,
                                    uint32_t serial,
                                    uint32_t encrypted,
-                                   uint16_t te_us,
+                                   uint8_t trailer,
                                    bool preamble,
                                    bool header,
                                    bool guard)
 {
-  uint16_t bit_len = HCS300_DATA_BITS_TE;
-  uint8_t data[HCS300_CODEWORD_DATA_BYTES];
-
-  memset(data, 0, sizeof(data));
-  memset(codeword, 0, *codeword_len);
+  const hcs300_tx_template_t *tx_template = &hcs300->tx_template;
+  uint16_t bit_len = protocol->data_bits * protocol->bit_te;
+  hcs300_packet_t packet;
+  hcs300_codeword_t data;
+  uint16_t chips_per_te = tx_template->chips_per_te;
+
+  // Every TE is sent as a whole number of PHY bits (chips)
+  if (chips_per_te == 0) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
 
   if (preamble) {
-    bit_len += HCS300_PREAMBLE_TE;
+    bit_len += protocol->preamble_te + protocol->sync_te;
   }
   if (header) {
-    bit_len += HCS300_HEADER_GAP_TE;
+    bit_len += protocol->header_te;
   }
   if (guard) {
-    bit_len += (hcs300->config->guard_time_us + te_us - 1) / te_us;
+    // The guard time of the HCS300 whatever the protocol, the buffers and
+    // the PHY frame are sized for it
+    bit_len += HCS300_GUARD_TE;
   }
+  bit_len *= chips_per_te;
   uint16_t cw_len_min = (bit_len + 7) >> 3;
 
   if (*codeword_len < cw_len_min) {
     return SL_STATUS_WOULD_OVERFLOW;
   }
 
-  data[0] = encrypted & 0xFF;
-  data[1] = (encrypted >> 8) & 0xFF;
-  data[2] = (encrypted >> 16) & 0xFF;
-  data[3] = (encrypted >> 24) & 0xFF;
-  data[4] = serial & 0xFF;
-  data[5] = (serial >> 8) & 0xFF;
-  data[6] = (serial >> 16) & 0xFF;
-  data[7] = (serial >> 24) & 0x0F;
-  // Button code bits: S3, S0, S1, S2 (LSB first)
-  uint8_t btn_code = ((HCS300_BTN_STATUS_S3(btn_status) ? 1 : 0) << 0)
-                   | ((HCS300_BTN_STATUS_S0(btn_status) ? 1 : 0) << 1)
-                   | ((HCS300_BTN_STATUS_S1(btn_status) ? 1 : 0) << 2)
-                   | ((HCS300_BTN_STATUS_S2(btn_status) ? 1 : 0) << 3);
-  data[7] |= (btn_code << 4);
-  data[8] = (vlow ? 1 : 0) << 0;
-  data[8] |= (rpt  ? 1 : 0) << 1;
-
+  // Same layout as the decoder assembles
+  packet.encrypted = encrypted;
+  packet.serial = serial;
+  packet.s0 = HCS300_BTN_STATUS_S0(btn_status) ? 1 : 0;
+  packet.s1 = HCS300_BTN_STATUS_S1(btn_status) ? 1 : 0;
+  packet.s2 = HCS300_BTN_STATUS_S2(btn_status) ? 1 : 0;
+  packet.s3 = HCS300_BTN_STATUS_S3(btn_status) ? 1 : 0;
+  packet.vlow = vlow ? 1 : 0;
+  packet.rpt = rpt ? 1 : 0;
+  packet.trailer = trailer;
+  hcs300_codeword_pack(protocol, &packet, &data);
+
+  // Every chip up to the length is written, the codeword array may be the TX
+  // buffer of the radio with the previous code word in it
   uint16_t cw_bit_idx = 0;
   if (preamble) {
-    // Set preamble bits (50% duty cycle) into codeword array
-    for (cw_bit_idx = 0; cw_bit_idx < HCS300_PREAMBLE_TE; cw_bit_idx +=2) {
-      uint16_t byte_idx = cw_bit_idx >> 3;
-      uint8_t bit_offset = cw_bit_idx & 0x7;
-      codeword[byte_idx] |= (1 << bit_offset);
+    if (protocol->preamble_te * chips_per_te == tx_template->preamble_chips) {
+      // The code word starts with the preamble, the template is copied as is
+      // (the chips after it in its last byte are overwritten)
+      memcpy(codeword, tx_template->preamble, (tx_template->preamble_chips + 7) >> 3);
+      cw_bit_idx = tx_template->preamble_chips;
+    } else {
+      for (uint16_t te_idx = 0; te_idx < protocol->preamble_te; te_idx++) {
+        hcs300_chips_append_level(codeword, &cw_bit_idx, chips_per_te, (te_idx & 1) == 0);
+      }
     }
+    // Sync pulse of fixed-code protocols
+    hcs300_chips_append_level(codeword, &cw_bit_idx, protocol->sync_te * chips_per_te, true);
   }
 
   if (header) {
-    // The codeword array is already cleared so just advance the index
-    cw_bit_idx += HCS300_HEADER_GAP_TE;
+    append_low_chips(codeword, &cw_bit_idx, protocol->header_te * chips_per_te);
   }
 
-  for (uint32_t data_bit_idx = 0; data_bit_idx < HCS300_DATA_BITS; data_bit_idx++) {
-    uint8_t data_byte = data[data_bit_idx >> 3];
-    uint8_t data_bit = (data_byte >> (data_bit_idx & 0x7)) & 0x1;
-
-    uint8_t pwm_pattern[2][3] = {
-      {1, 1, 0}, // logical 0
-      {1, 0, 0}  // logical 1
-    };
+  cw_bit_idx = hcs300_codeword_expand(protocol, &data, chips_per_te, codeword, cw_bit_idx);
 
-    for (uint8_t pwm_idx = 0; pwm_idx < HCS300_BIT_TE; pwm_idx++, cw_bit_idx++) {
-        uint32_t byte_idx = cw_bit_idx >> 3;
-        uint8_t bit_offset = cw_bit_idx & 0x7;
-        uint8_t pwm_bit = pwm_pattern[data_bit][pwm_idx];
-        codeword[byte_idx] |= (pwm_bit << bit_offset);
-    }
-  }
+  // The guard time is low, so is the rest of VPWM frames (shorter than their
+  // bit_te based length)
+  hcs300_chips_clear(codeword, cw_bit_idx, cw_len_min);
   *codeword_len = cw_len_min;
   return SL_STATUS_OK;
 }
 
 SL_WEAK void hcs300_on_rx_packet(uint16_t hcs300_id,
+                                 const hcs300_protocol_t *protocol,
                                  bool rpt,
                                  bool vlow,
                                  uint8_t btn_status,
                                  uint32_t serial,
-                                 uint32_t encrypted)
+                                 uint32_t encrypted,
+                                 uint8_t trailer)
 {
   (void)hcs300_id;
+  (void)protocol;
   (void)rpt;
   (void)vlow;
   (void)btn_status;
   (void)serial;
   (void)encrypted;
+  (void)trailer;
 }
\ No newline at end of file
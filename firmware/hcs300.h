@@ -8,7 +8,9 @@
 
 // HCS300 protocol parameters
 // All timings values are integer multiples of TE.
-// TE is configurable between: 100us, 200us, 400us.
+// TE is configurable between: 100us, 200us, 400us, the receiver detects it
+// from the preamble and the packets are forwarded with the same TE rounded to
+// the bit period of the PHY (a shorter TE is sent with the bit period).
 // Packet:
 //   - Preamble: 23 TE (12 sync pulses) - 50% duty cycle
 //   - Header: 10 TE gap
@@ -33,10 +35,38 @@
 // Total code word data length in TE units (each bit is encoded in 3 TE - PWM modulated)
 #define HCS300_DATA_BITS_TE         (HCS300_DATA_BITS * HCS300_BIT_TE)
 
-#define HCS300_CODEWORD_DATA_BYTES  ((HCS300_DATA_BITS_TE + 7) >> 3)
+// Header capture and the data bits captures (high and low levels), the low
+// level of the last bit is merged into the guard time so it isn't captured.
+#define HCS300_DATA_BITS_CAPTURES   (2 * HCS300_DATA_BITS)
+
+// HCS361 and HCS362 append CRC bits (and queue bits) to the same fields, they
+// have the longest code words of the supported protocols
+#define HCS361_DATA_BITS              67
+#define HCS362_DATA_BITS              69
+
+// Buffers of code words are sized for the longest data portion (HCS362 with
+// PWM bits), every other protocol fits into them with 1 chip per TE
+#define HCS300_MAX_DATA_BITS_TE     (HCS362_DATA_BITS * HCS300_BIT_TE)
+
+// Guard time of the HCS300 (39 TE), sent after every code word. Frames with
+// the guard time fit into these.
+#define HCS300_GUARD_TE             39
+
+#define HCS300_CODEWORD_DATA_BYTES  ((HCS300_MAX_DATA_BITS_TE \
+                                    + HCS300_GUARD_TE + 7) >> 3)
 #define HCS300_CODEWORD_BYTES       ((HCS300_PREAMBLE_TE    \
                                     + HCS300_HEADER_GAP_TE  \
-                                    + HCS300_DATA_BITS_TE + 7) >> 3)
+                                    + HCS300_MAX_DATA_BITS_TE + 7) >> 3)
+#define HCS300_FRAME_BYTES          ((HCS300_PREAMBLE_TE    \
+                                    + HCS300_HEADER_GAP_TE  \
+                                    + HCS300_MAX_DATA_BITS_TE \
+                                    + HCS300_GUARD_TE + 7) >> 3)
+
+// Fixed length of the PHY frame, fixed_length_size of radio_settings.radioconf
+// shall be the same: the HCS300 data portion and the guard time at 1 chip per
+// TE (the PHY sends the preamble and the header). The length of every
+// transmission is set to its code word, this is the one the PHY starts with.
+#define HCS300_PHY_FIXED_LENGTH_BYTES 30
 
 // Button status getter macros
 #define HCS300_BTN_STATUS_S0(btn_status)  ((btn_status) & HCS300_S0)
@@ -52,6 +82,67 @@ typedef enum hcs300_sw_id {
   HCS300_S3 = 0x8,
 } hcs300_sw_id_t;
 
+// How the decoder synchronized to the data of a frame
+typedef enum hcs300_sync {
+  // Preamble (TE estimate) followed by the header, the regular path
+  HCS300_SYNC_PREAMBLE,
+  // Data found backward from the end of the frame with the header in front
+  // of it, the preamble was short or damaged
+  HCS300_SYNC_HEADER,
+  // Data found backward from the end of the frame, the header was damaged too
+  HCS300_SYNC_DATA,
+} hcs300_sync_t;
+
+// Reception details of a received frame
+typedef struct hcs300_frame_info {
+  // Timestamps of the first and the last captured edge of the frame in us
+  // (timer ticks extended to 64 bits), only with free-running timebase.
+  uint64_t start_us;
+  uint64_t end_us;
+  // Time since the last edge of the previous frame, zero for the first frame
+  uint64_t gap_us;
+  // Capture interrupts taken by the frame (TIMER0 and LDMA), the same frame
+  // costs about one interrupt per edge in IRQ capture mode.
+  uint16_t irq_count;
+  // Spikes removed by the glitch filter from this frame and since init
+  uint16_t glitch_count;
+  uint32_t glitch_total;
+  // TE tracked until the end of the frame and its drift relative to the TE
+  // measured in the preamble
+  uint32_t te_us;
+  int32_t  te_drift_ppm;
+  // Tolerance of the data levels picked from the preamble jitter
+  uint8_t  te_tolerance_pct;
+  // Number of repeated frames the packet was combined from by majority vote,
+  // zero if the frame was decoded on its own
+  uint8_t  combined_frames;
+  // TE setting of the encoder (100, 200 or 400 us), detected from the
+  // preamble unless it is configured, zero if it doesn't match any of them
+  // or the protocol has no preamble (fixed-code encoders have no settings)
+  uint16_t te_nominal_us;
+  // Recovery path of frames with damaged preamble or header
+  hcs300_sync_t sync;
+  // Frames of the same code received before this one within the repeat
+  // window, zero for the first frame of a press
+  uint16_t repeat_count;
+  // Name of the matched protocol of the registry
+  const char *protocol;
+} hcs300_frame_info_t;
+
+// Counters of the duplicate suppression in front of hcs300_on_rx_packet()
+typedef struct hcs300_dup_stats {
+  // Decoded packets, forwarded to the callback and dropped as repeats
+  uint32_t received;
+  uint32_t forwarded;
+  uint32_t suppressed;
+} hcs300_dup_stats_t;
+
+// Quantized frame representation, see hcs300_decoder.h
+typedef struct hcs300_symbol_frame hcs300_symbol_frame_t;
+
+// Protocol descriptor, see hcs300_decoder.h
+typedef struct hcs300_protocol hcs300_protocol_t;
+
 sl_status_t hcs300_init(void);
 sl_status_t hcs300_deinit(void);
 sl_status_t hcs300_activate(hcs300_sw_id_t sw, bool repeat);
@@ -59,29 +150,76 @@ void hcs300_step(void);
 
 void hcs300_proceed_cb(void);
 
+// Reception details of the packet delivered last by hcs300_on_rx_packet(),
+// it can be called from the callback.
+sl_status_t hcs300_get_last_frame_info(hcs300_frame_info_t *info);
+
+// Current time of the free-running timebase in us, same clock as the frame
+// timestamps (e.g. to correlate them with RAIL timestamps).
+sl_status_t hcs300_get_timestamp_us(uint64_t *timestamp_us);
+
+// Counters of the packets forwarded and suppressed as repeats of a press
+// since init
+sl_status_t hcs300_get_dup_stats(hcs300_dup_stats_t *stats);
+
+// Copy a frame from the history of received frames, age 0 is the most recent one.
+sl_status_t hcs300_get_history_frame(uint8_t age, hcs300_symbol_frame_t *frame);
+
+// The code word of the given protocol, fields missing from the protocol are
+// ignored. The preamble is the sync pulse of fixed-code protocols and the
+// header is the sync low.
 sl_status_t hcs300_create_codeword(uint16_t hcs300_id,
+                                   const hcs300_protocol_t *protocol,
                                    uint8_t *codeword,
                                    uint16_t *codeword_len,
                                    bool rpt,
                                    bool vlow,
                                    uint8_t btn_status,
                                    uint32_t serial,
-                                   uint32_t encrypted);
-
+                                   uint32_t encrypted,
+                                   uint8_t trailer);
+
+// Standalone frame: the code word followed by the guard time (low chips), so
+// repeated frames can be sent back to back
+sl_status_t hcs300_create_frame(uint16_t hcs300_id,
+                                const hcs300_protocol_t *protocol,
+                                uint8_t *codeword,
+                                uint16_t *codeword_len,
+                                bool rpt,
+                                bool vlow,
+                                uint8_t btn_status,
+                                uint32_t serial,
+                                uint32_t encrypted,
+                                uint8_t trailer);
+
+// Code word without the parts sent by the PHY (KEELOQ preamble and header),
+// the sync of fixed-code protocols is included. It ends with the guard time,
+// so the transmission of the next code word can start as soon as it is sent.
+// Every byte up to the returned
+// length is written and nothing beyond it, the buffer doesn't need to be
+// cleared, so the code word can be encoded in place into the TX buffer of the
+// radio.
 sl_status_t hcs300_create_codeword_data(uint16_t hcs300_id,
+                                        const hcs300_protocol_t *protocol,
                                         uint8_t *codeword,
                                         uint16_t *codeword_len,
                                         bool rpt,
                                         bool vlow,
                                         uint8_t btn_status,
                                         uint32_t serial,
-                                        uint32_t encrypted);
+                                        uint32_t encrypted,
+                                        uint8_t trailer);
 
+// Packets of every registered protocol, fixed-code protocols only have the
+// serial (address) and the button code. The trailer holds the bits after VLOW
+// (CRC and queue bits of HCS361 and HCS362), the encoders send them unchanged.
 void hcs300_on_rx_packet(uint16_t hcs300_id,
+                         const hcs300_protocol_t *protocol,
                          bool rpt,
                          bool vlow,
                          uint8_t btn_status,
                          uint32_t serial,
-                         uint32_t encrypted);
+                         uint32_t encrypted,
+                         uint8_t trailer);
 #endif // HCS300_H
 
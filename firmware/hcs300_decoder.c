@@ -0,0 +1,1526 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+
+#include "sl_status.h"
+#include "sl_common.h"
+
+// HCS300 supports 4 buttons
+#define HCS300_BUTTON_CODE_BITS        4
+
+// Serial number stored in HCS300
+#define HCS300_SERIAL_NUM_BITS        28
+
+#define HCS300_SERIAL_NUM_OFFSET      HCS300_ENCRYPTED_BITS
+#define HCS300_BUTTON_CODE_OFFSET     (HCS300_SERIAL_NUM_OFFSET + HCS300_SERIAL_NUM_BITS)
+#define HCS300_VLOW_OFFSET            (HCS300_BUTTON_CODE_OFFSET + HCS300_BUTTON_CODE_BITS)
+#define HCS300_RPT_OFFSET             (HCS300_VLOW_OFFSET + 1)
+
+// CRC (2 bits) of HCS361, CRC and queue bits (2 bits) of HCS362 after VLOW
+#define HCS36X_TRAILER_OFFSET         (HCS300_VLOW_OFFSET + 1)
+#define HCS361_TRAILER_BITS           (HCS361_DATA_BITS - HCS36X_TRAILER_OFFSET)
+#define HCS362_TRAILER_BITS           (HCS362_DATA_BITS - HCS36X_TRAILER_OFFSET)
+
+// Fixed-code sync is 1 TE high and 31 TE low (4 and 124 oscillator periods of
+// PT2262), a bit is 4 TE
+#define HCS300_FIXED_SYNC_TE           1
+#define HCS300_FIXED_SYNC_GAP_TE      31
+#define HCS300_FIXED_BIT_TE            4
+#define HCS300_FIXED_DATA_BITS        24
+
+#define HCS300_EV1527_ADDRESS_BITS    20
+#define HCS300_EV1527_DATA_BITS        4
+
+// Manchester bits are two 1 TE halves, VPWM levels are 1 TE or 2 TE
+#define HCS300_LEVEL_BIT_TE            2
+
+// Bits of the packed code word, the rest is in the tail
+#define HCS300_CODEWORD_WORD_BITS     64
+#define HCS300_CODEWORD_TAIL_BITS     8
+
+static_assert(HCS300_PROTOCOL_MAX_DATA_BITS
+              <= HCS300_CODEWORD_WORD_BITS + HCS300_CODEWORD_TAIL_BITS,
+              "Packed code word can't hold the longest data portion");
+
+// Levels after the last data bit skipped while searching backward (noise
+// before the guard time)
+#define HCS300_RESYNC_MAX_TRAILING    3
+
+// Soft value of a bit 1 TE off the decision threshold (a clean bit)
+#define HCS300_SOFT_ONE_TE            64
+
+// Fixed field bits of a frame and of the combined frames contradict each
+// other if both are decided at least this far from the threshold
+#define HCS300_COMBINER_MISMATCH_SOFT (HCS300_SOFT_ONE_TE / 2)
+
+// Chips of a PWM data bit sent with 1 chip per TE, LSB first (the first chip
+// is the lowest bit): 3 TE bits have a 1 TE high level for a '1' and a 2 TE
+// one for a '0', inverted 4 TE bits have a 3 TE high level for a '1' and a
+// 1 TE one for a '0'
+#define HCS300_PWM3_CHIPS(bit)        ((bit) ? 0x1 : 0x3)
+#define HCS300_PWM4_INV_CHIPS(bit)    ((bit) ? 0x7 : 0x1)
+
+#define HCS300_NIBBLE_CHIPS(chips, bit_te, nibble)        \
+        ((chips((nibble) & 1))                            \
+         | (chips(((nibble) >> 1) & 1) << (bit_te))      \
+         | (chips(((nibble) >> 2) & 1) << (2 * (bit_te))) \
+         | (chips(((nibble) >> 3) & 1) << (3 * (bit_te))))
+
+#define HCS300_NIBBLE_LUT(chips, bit_te)                                          \
+        {                                                                         \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 0), HCS300_NIBBLE_CHIPS(chips, bit_te, 1),   \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 2), HCS300_NIBBLE_CHIPS(chips, bit_te, 3),   \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 4), HCS300_NIBBLE_CHIPS(chips, bit_te, 5),   \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 6), HCS300_NIBBLE_CHIPS(chips, bit_te, 7),   \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 8), HCS300_NIBBLE_CHIPS(chips, bit_te, 9),   \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 10), HCS300_NIBBLE_CHIPS(chips, bit_te, 11), \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 12), HCS300_NIBBLE_CHIPS(chips, bit_te, 13), \
+          HCS300_NIBBLE_CHIPS(chips, bit_te, 14), HCS300_NIBBLE_CHIPS(chips, bit_te, 15), \
+        }
+
+static bool is_within_tolerance(uint32_t value,
+                                uint32_t target,
+                                uint32_t tolerance);
+static bool is_within_rel_tolerance(uint32_t value,
+                                    uint32_t target,
+                                    uint8_t rel_tolerance_pct);
+
+static sl_status_t process_preamble_header(hcs300_decoder_t *decoder,
+                                           uint32_t duration);
+static sl_status_t process_first_bit(hcs300_decoder_t *decoder,
+                                     uint32_t duration);
+static sl_status_t process_data_low(hcs300_decoder_t *decoder,
+                                    uint32_t duration);
+static sl_status_t process_trailing_sync(hcs300_decoder_t *decoder,
+                                         uint32_t duration);
+static sl_status_t process_data_level(hcs300_decoder_t *decoder,
+                                      uint32_t duration);
+static sl_status_t store_half_bit(hcs300_decoder_t *decoder, bool high);
+static sl_status_t store_level_bit(hcs300_decoder_t *decoder, uint8_t bit);
+static void start_data(hcs300_decoder_t *decoder);
+static bool is_inverted(const hcs300_decoder_t *decoder);
+static bool is_pwm(const hcs300_protocol_t *protocol);
+static uint8_t long_te(const hcs300_protocol_t *protocol);
+static sl_status_t decode_pwm(hcs300_decoder_t *decoder,
+                              uint32_t high_duration,
+                              uint32_t low_duration,
+                              uint8_t *bit);
+static sl_status_t decode_last_pwm(hcs300_decoder_t *decoder,
+                                   uint32_t high_duration,
+                                   uint8_t *bit);
+static int8_t soft_value(const hcs300_decoder_t *decoder, int32_t distance_ticks);
+static sl_status_t decide_weak_bit(hcs300_decoder_t *decoder,
+                                   const hcs300_decoder_window_t *window,
+                                   uint32_t duration,
+                                   uint8_t *bit);
+static sl_status_t store_data_bit(hcs300_decoder_t *decoder, uint8_t bit);
+static int16_t combined_soft_bit(const hcs300_combiner_t *combiner, uint8_t bit_idx);
+static bool is_same_press(const hcs300_combiner_t *combiner,
+                          const hcs300_decoder_t *decoder);
+static void record_level(hcs300_decoder_t *decoder,
+                         hcs300_decoder_state_t prev_state,
+                         uint32_t duration);
+static sl_status_t resync_at(hcs300_decoder_t *decoder,
+                             const uint32_t *levels,
+                             uint16_t data_idx);
+static uint32_t get_field(const hcs300_codeword_t *codeword, hcs300_field_t field);
+static void set_field(hcs300_codeword_t *codeword, hcs300_field_t field, uint32_t value);
+static void lock_te(hcs300_decoder_t *decoder);
+static void track_te(hcs300_decoder_t *decoder, uint32_t bit_duration);
+static void track_te_level(hcs300_decoder_t *decoder, uint32_t duration, uint8_t te_cnt);
+static void update_windows(hcs300_decoder_t *decoder);
+static const uint16_t *get_nibble_lut(const hcs300_protocol_t *protocol,
+                                      uint16_t chips_per_te);
+static uint16_t expand_nibbles(uint8_t *chips,
+                               uint16_t chip_idx,
+                               const hcs300_codeword_t *codeword,
+                               uint8_t data_bits,
+                               uint8_t bit_te,
+                               const uint16_t *lut);
+static hcs300_symbol_t quantize(const hcs300_decoder_t *decoder, uint32_t duration);
+
+// Chip patterns of 4 data bits (12 or 16 chips), the data portion of the PWM
+// protocols is expanded a nibble at a time
+static const uint16_t hcs300_pwm3_nibble_lut[16] = HCS300_NIBBLE_LUT(HCS300_PWM3_CHIPS, 3);
+static const uint16_t hcs300_pwm4_inv_nibble_lut[16] = HCS300_NIBBLE_LUT(HCS300_PWM4_INV_CHIPS, 4);
+
+// Replay of recorded symbol frames, the levels after the preamble are exact
+// (TE is kept locked) and the preamble was accepted when it was recorded
+static const hcs300_decoder_config_t hcs300_symbol_replay_config = {
+  .min_preamble_pulses = 1,
+  .te_tolerance_init_pct = 20,
+  .te_tolerance_prec_pct = 2,
+  .te_tracking_shift = 0,
+  .max_weak_bits = 0,
+};
+
+// HCS200, HCS201, HCS300 and HCS301 share the code word
+const hcs300_protocol_t hcs300_protocol_keeloq_pwm = {
+  .name = "KEELOQ PWM",
+  .encoding = HCS300_BIT_ENCODING_PWM,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_BIT_TE,
+  .data_bits = HCS300_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .rpt = { .offset = HCS300_RPT_OFFSET, .bits = 1 },
+};
+
+const hcs300_protocol_t hcs300_protocol_ev1527 = {
+  .name = "EV1527",
+  .encoding = HCS300_BIT_ENCODING_PWM_INVERTED,
+  .preamble_te = 0,
+  .header_te = HCS300_FIXED_SYNC_GAP_TE,
+  .sync_te = HCS300_FIXED_SYNC_TE,
+  .bit_te = HCS300_FIXED_BIT_TE,
+  .data_bits = HCS300_FIXED_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .serial = { .offset = 0, .bits = HCS300_EV1527_ADDRESS_BITS },
+  .button = { .offset = HCS300_EV1527_ADDRESS_BITS, .bits = HCS300_EV1527_DATA_BITS },
+};
+
+const hcs300_protocol_t hcs300_protocol_pt2262 = {
+  .name = "PT2262",
+  .encoding = HCS300_BIT_ENCODING_PWM_INVERTED,
+  .preamble_te = 0,
+  .header_te = HCS300_FIXED_SYNC_GAP_TE,
+  .sync_te = HCS300_FIXED_SYNC_TE,
+  .bit_te = HCS300_FIXED_BIT_TE,
+  .data_bits = HCS300_FIXED_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .serial = { .offset = 0, .bits = HCS300_FIXED_DATA_BITS },
+};
+
+// HCS361 and HCS362 share the fields of KEELOQ PWM, CRC (and queue) bits
+// follow VLOW
+const hcs300_protocol_t hcs300_protocol_hcs361_manchester = {
+  .name = "HCS361 MANCHESTER",
+  .encoding = HCS300_BIT_ENCODING_MANCHESTER,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_LEVEL_BIT_TE,
+  .data_bits = HCS361_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .trailer = { .offset = HCS36X_TRAILER_OFFSET, .bits = HCS361_TRAILER_BITS },
+};
+
+const hcs300_protocol_t hcs300_protocol_hcs361_vpwm = {
+  .name = "HCS361 VPWM",
+  .encoding = HCS300_BIT_ENCODING_VPWM,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_LEVEL_BIT_TE,
+  .data_bits = HCS361_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .trailer = { .offset = HCS36X_TRAILER_OFFSET, .bits = HCS361_TRAILER_BITS },
+};
+
+const hcs300_protocol_t hcs300_protocol_hcs362_manchester = {
+  .name = "HCS362 MANCHESTER",
+  .encoding = HCS300_BIT_ENCODING_MANCHESTER,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_LEVEL_BIT_TE,
+  .data_bits = HCS362_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .trailer = { .offset = HCS36X_TRAILER_OFFSET, .bits = HCS362_TRAILER_BITS },
+};
+
+const hcs300_protocol_t hcs300_protocol_hcs362_vpwm = {
+  .name = "HCS362 VPWM",
+  .encoding = HCS300_BIT_ENCODING_VPWM,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_LEVEL_BIT_TE,
+  .data_bits = HCS362_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .trailer = { .offset = HCS36X_TRAILER_OFFSET, .bits = HCS362_TRAILER_BITS },
+};
+
+const hcs300_protocol_t hcs300_protocol_hcs362_pwm = {
+  .name = "HCS362 PWM",
+  .encoding = HCS300_BIT_ENCODING_PWM,
+  .preamble_te = HCS300_PREAMBLE_TE,
+  .header_te = HCS300_HEADER_GAP_TE,
+  .sync_te = 0,
+  .bit_te = HCS300_BIT_TE,
+  .data_bits = HCS362_DATA_BITS,
+  .te_tolerance_max_pct = 20,
+  .encrypted = { .offset = 0, .bits = HCS300_ENCRYPTED_BITS },
+  .serial = { .offset = HCS300_SERIAL_NUM_OFFSET, .bits = HCS300_SERIAL_NUM_BITS },
+  .button = { .offset = HCS300_BUTTON_CODE_OFFSET, .bits = HCS300_BUTTON_CODE_BITS },
+  .vlow = { .offset = HCS300_VLOW_OFFSET, .bits = 1 },
+  .trailer = { .offset = HCS36X_TRAILER_OFFSET, .bits = HCS362_TRAILER_BITS },
+};
+
+void hcs300_decoder_reset(hcs300_decoder_t *decoder,
+                          const hcs300_decoder_config_t *config)
+{
+  memset(decoder, 0, sizeof(*decoder));
+  decoder->config = config;
+  decoder->protocol = &hcs300_protocol_keeloq_pwm;
+  decoder->state = HCS300_DECODER_STATE_PREAMBLE;
+  decoder->status = SL_STATUS_IN_PROGRESS;
+}
+
+sl_status_t hcs300_decoder_set_protocol(hcs300_decoder_t *decoder,
+                                        const hcs300_protocol_t *protocol)
+{
+  bool valid;
+
+  switch (protocol->encoding) {
+    case HCS300_BIT_ENCODING_PWM:
+    case HCS300_BIT_ENCODING_PWM_INVERTED:
+      valid = protocol->bit_te >= 3;
+      break;
+    case HCS300_BIT_ENCODING_MANCHESTER:
+      valid = protocol->bit_te == HCS300_LEVEL_BIT_TE && protocol->preamble_te != 0;
+      break;
+    case HCS300_BIT_ENCODING_VPWM:
+      // The last level shall be a high one
+      valid = protocol->bit_te == HCS300_LEVEL_BIT_TE && protocol->preamble_te != 0
+              && (protocol->data_bits & 1) != 0;
+      break;
+    default:
+      valid = false;
+      break;
+  }
+
+  if (!valid
+      || protocol->data_bits == 0
+      || protocol->data_bits > HCS300_PROTOCOL_MAX_DATA_BITS) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  decoder->protocol = protocol;
+
+  return SL_STATUS_OK;
+}
+
+uint16_t hcs300_protocol_min_levels(const hcs300_protocol_t *protocol)
+{
+  if (is_pwm(protocol)) {
+    // A high and a low level per bit, the low of the last one is the guard
+    return 2 * protocol->data_bits - 1;
+  }
+
+  // Every VPWM bit is a level, a Manchester bit has a transition in its
+  // middle
+  return protocol->data_bits - 1;
+}
+
+sl_status_t hcs300_decoder_feed(hcs300_decoder_t *decoder, uint32_t duration)
+{
+  sl_status_t sc;
+  uint8_t bit;
+  hcs300_decoder_state_t prev_state = decoder->state;
+
+  switch (decoder->state) {
+    case HCS300_DECODER_STATE_PREAMBLE:
+      if (decoder->protocol->preamble_te == 0) {
+        // Fixed-code frames start with the data
+        sc = process_first_bit(decoder, duration);
+      } else {
+        sc = process_preamble_header(decoder, duration);
+      }
+      break;
+
+    case HCS300_DECODER_STATE_DATA_HIGH:
+      if (decoder->data_bit_idx == decoder->protocol->data_bits - 1) {
+        // The low level of the last bit is merged into the guard time
+        decoder->high_ticks = duration;
+        sc = decode_last_pwm(decoder, duration, &bit);
+        if (sc == SL_STATUS_OK) {
+          sc = store_data_bit(decoder, bit);
+        }
+        if (sc == SL_STATUS_OK) {
+          decoder->state = HCS300_DECODER_STATE_DONE;
+          if (decoder->weak_bit_cnt != 0) {
+            // Soft complete, only the combiner can make use of the frame
+            sc = SL_STATUS_INVALID_RANGE;
+          }
+        }
+      } else {
+        decoder->high_ticks = duration;
+        decoder->state = HCS300_DECODER_STATE_DATA_LOW;
+        sc = SL_STATUS_IN_PROGRESS;
+      }
+      break;
+
+    case HCS300_DECODER_STATE_DATA_LOW:
+      sc = process_data_low(decoder, duration);
+      break;
+
+    case HCS300_DECODER_STATE_DATA_LEVEL:
+      sc = process_data_level(decoder, duration);
+      break;
+
+    case HCS300_DECODER_STATE_DONE:
+      sc = process_trailing_sync(decoder, duration);
+      break;
+
+    case HCS300_DECODER_STATE_ERROR:
+    default:
+      // Keep recording the rest of the frame for diagnostics
+      record_level(decoder, prev_state, duration);
+      return decoder->status;
+  }
+
+  // A soft complete frame stays done with its result
+  if (sc != SL_STATUS_IN_PROGRESS
+      && sc != SL_STATUS_OK
+      && decoder->state != HCS300_DECODER_STATE_DONE) {
+    decoder->state = HCS300_DECODER_STATE_ERROR;
+  }
+  decoder->status = sc;
+
+  record_level(decoder, prev_state, duration);
+
+  return sc;
+}
+
+sl_status_t hcs300_decoder_resync(hcs300_decoder_t *decoder,
+                                  const uint32_t *levels,
+                                  uint16_t level_cnt)
+{
+  sl_status_t sc = SL_STATUS_INVALID_COUNT;
+  uint16_t trailing;
+
+  // Every data level except the trailing low of the last bit
+  uint16_t data_levels = 2 * decoder->protocol->data_bits - 1;
+
+  if (!is_pwm(decoder->protocol)) {
+    // The number of data levels depends on the data
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  for (trailing = 0;
+       trailing <= HCS300_RESYNC_MAX_TRAILING
+       && level_cnt >= data_levels + trailing;
+       trailing++) {
+    sc = resync_at(decoder, levels, level_cnt - trailing - data_levels);
+    if (sc == SL_STATUS_OK) {
+      break;
+    }
+  }
+
+  return sc;
+}
+
+void hcs300_decoder_set_record(hcs300_decoder_t *decoder,
+                               hcs300_symbol_frame_t *record)
+{
+  decoder->record = record;
+  if (record != NULL) {
+    memset(record, 0, sizeof(*record));
+  }
+}
+
+hcs300_symbol_t hcs300_symbol_frame_get(const hcs300_symbol_frame_t *frame,
+                                        uint8_t symbol_idx)
+{
+  uint8_t byte = frame->symbols[symbol_idx / HCS300_SYMBOLS_PER_BYTE];
+  uint8_t shift = (symbol_idx % HCS300_SYMBOLS_PER_BYTE) * HCS300_SYMBOL_BITS;
+
+  return (hcs300_symbol_t)((byte >> shift) & ((1 << HCS300_SYMBOL_BITS) - 1));
+}
+
+sl_status_t hcs300_symbol_frame_decode(const hcs300_symbol_frame_t *frame,
+                                       hcs300_packet_t *packet)
+{
+  hcs300_decoder_t decoder;
+  sl_status_t sc = SL_STATUS_INVALID_COUNT;
+  uint8_t level_idx;
+
+  if (frame->protocol == NULL) {
+    return SL_STATUS_INVALID_COUNT;
+  }
+
+  hcs300_decoder_reset(&decoder, &hcs300_symbol_replay_config);
+  sc = hcs300_decoder_set_protocol(&decoder, frame->protocol);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  if (frame->lock_ticks[1] == 0) {
+    // TE hasn't been locked, there is no data
+    return SL_STATUS_INVALID_COUNT;
+  }
+  for (level_idx = 0; level_idx < frame->preamble_len; level_idx++) {
+    (void) hcs300_decoder_feed(&decoder, frame->preamble[level_idx]);
+  }
+  if (frame->lock_ticks[0] != 0) {
+    (void) hcs300_decoder_feed(&decoder, frame->lock_ticks[0]);
+  }
+  sc = hcs300_decoder_feed(&decoder, frame->lock_ticks[1]);
+
+  // TE is locked by the raw levels, the symbols are exact multiples of it
+  for (level_idx = 0; level_idx < frame->symbol_len; level_idx++) {
+    hcs300_symbol_t symbol = hcs300_symbol_frame_get(frame, level_idx);
+    uint8_t symbol_te;
+
+    switch (symbol) {
+      case HCS300_SYMBOL_1TE:
+        symbol_te = 1;
+        break;
+      case HCS300_SYMBOL_2TE:
+        symbol_te = long_te(frame->protocol);
+        break;
+      case HCS300_SYMBOL_HEADER:
+        symbol_te = frame->protocol->header_te;
+        break;
+      default:
+        return SL_STATUS_INVALID_RANGE;
+    }
+
+    sc = hcs300_decoder_feed(&decoder, symbol_te * decoder.te_ticks);
+  }
+
+  if (decoder.state != HCS300_DECODER_STATE_DONE) {
+    return (sc == SL_STATUS_IN_PROGRESS) ? SL_STATUS_INVALID_COUNT : sc;
+  }
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  *packet = decoder.data;
+
+  return SL_STATUS_OK;
+}
+
+void hcs300_glitch_filter_reset(hcs300_glitch_filter_t *filter, uint32_t min_ticks)
+{
+  memset(filter, 0, sizeof(*filter));
+  filter->min_ticks = min_ticks;
+  filter->state = HCS300_GLITCH_FILTER_STATE_EMPTY;
+}
+
+bool hcs300_glitch_filter_feed(hcs300_glitch_filter_t *filter,
+                               uint32_t duration,
+                               uint32_t *level)
+{
+  if (filter->min_ticks == 0) {
+    *level = duration;
+    return true;
+  }
+
+  switch (filter->state) {
+    case HCS300_GLITCH_FILTER_STATE_EMPTY:
+      filter->pending_ticks = duration;
+      filter->state = HCS300_GLITCH_FILTER_STATE_PENDING;
+      return false;
+
+    case HCS300_GLITCH_FILTER_STATE_PENDING:
+      if (duration < filter->min_ticks) {
+        // Spike, the pending level continues after it
+        filter->pending_ticks += duration;
+        filter->state = HCS300_GLITCH_FILTER_STATE_GLITCH;
+        filter->glitch_cnt++;
+        return false;
+      }
+      *level = filter->pending_ticks;
+      filter->pending_ticks = duration;
+      return true;
+
+    case HCS300_GLITCH_FILTER_STATE_GLITCH:
+    default:
+      // Rest of the level interrupted by the spike
+      filter->pending_ticks += duration;
+      filter->state = HCS300_GLITCH_FILTER_STATE_PENDING;
+      return false;
+  }
+}
+
+bool hcs300_glitch_filter_flush(hcs300_glitch_filter_t *filter, uint32_t *level)
+{
+  if (filter->state == HCS300_GLITCH_FILTER_STATE_EMPTY) {
+    return false;
+  }
+
+  // A trailing spike is part of the last level
+  *level = filter->pending_ticks;
+  filter->state = HCS300_GLITCH_FILTER_STATE_EMPTY;
+
+  return true;
+}
+
+bool hcs300_decoder_is_soft_complete(const hcs300_decoder_t *decoder)
+{
+  return decoder->data_bit_idx != 0
+         && decoder->data_bit_idx == decoder->protocol->data_bits;
+}
+
+hcs300_te_class_t hcs300_te_classify(uint32_t te_ticks, uint32_t te_100us_ticks)
+{
+  // Compared in squares, te < class * sqrt(2) is te^2 < 2 * class^2
+  uint64_t te_sq = (uint64_t) te_ticks * te_ticks;
+  uint64_t base_sq = (uint64_t) te_100us_ticks * te_100us_ticks;
+  uint8_t te_class;
+
+  if (2 * te_sq < base_sq) {
+    return HCS300_TE_CLASS_INVALID;
+  }
+
+  for (te_class = 0; te_class < HCS300_TE_CLASS_INVALID; te_class++) {
+    // Each class doubles the TE, its square is 4 times larger
+    if (te_sq < (2 * base_sq) << (2 * te_class)) {
+      return (hcs300_te_class_t) te_class;
+    }
+  }
+
+  return HCS300_TE_CLASS_INVALID;
+}
+
+uint16_t hcs300_relay_te_us(const hcs300_protocol_t *protocol,
+                            uint32_t te_nominal_us,
+                            uint32_t te_measured_us,
+                            uint16_t chip_us)
+{
+  // Only the KEELOQ encoders have TE settings, the TE of fixed-code encoders
+  // is set by a resistor
+  uint32_t te_us = (protocol->preamble_te != 0 && te_nominal_us != 0)
+                   ? te_nominal_us
+                   : te_measured_us;
+  uint32_t chips;
+
+  if (chip_us == 0) {
+    return 0;
+  }
+
+  chips = SL_MAX((te_us + chip_us / 2) / chip_us, 1);
+
+  return (uint16_t) SL_MIN(chips * chip_us, UINT16_MAX / chip_us * chip_us);
+}
+
+int32_t hcs300_decoder_te_drift_ppm(const hcs300_decoder_t *decoder)
+{
+  if (decoder->te_lock_ticks == 0) {
+    return 0;
+  }
+
+  return (int32_t)((((int64_t) decoder->te_q8 - ((int64_t) decoder->te_lock_ticks << 8))
+                    * 1000000) / ((int64_t) decoder->te_lock_ticks << 8));
+}
+
+void hcs300_combiner_reset(hcs300_combiner_t *combiner)
+{
+  memset(combiner, 0, sizeof(*combiner));
+}
+
+sl_status_t hcs300_combiner_add(hcs300_combiner_t *combiner,
+                                const hcs300_decoder_t *decoder,
+                                uint8_t min_frames,
+                                hcs300_packet_t *packet)
+{
+  hcs300_decoder_t combined;
+  uint8_t bit_idx;
+
+  if (!hcs300_decoder_is_soft_complete(decoder)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  // Frames of another transmitter (or another TE setting) restart the history
+  if (combiner->frame_cnt != 0
+      && (combiner->protocol != decoder->protocol
+          || !is_within_tolerance(decoder->te_lock_ticks,
+                              combiner->te_ticks,
+                              (uint32_t)(((uint64_t) combiner->te_ticks
+                                          * decoder->tolerance_q16) >> 16))
+          || !is_same_press(combiner, decoder))) {
+    hcs300_combiner_reset(combiner);
+  }
+  if (combiner->frame_cnt == 0) {
+    combiner->te_ticks = decoder->te_lock_ticks;
+    combiner->protocol = decoder->protocol;
+  }
+
+  memcpy(combiner->soft_bits[combiner->head],
+         decoder->soft_bits,
+         sizeof(combiner->soft_bits[0]));
+  combiner->head = (combiner->head + 1) % HCS300_COMBINER_DEPTH;
+  if (combiner->frame_cnt < HCS300_COMBINER_DEPTH) {
+    combiner->frame_cnt++;
+  }
+
+  if (min_frames == 0 || combiner->frame_cnt < min_frames) {
+    return SL_STATUS_IN_PROGRESS;
+  }
+
+  hcs300_decoder_reset(&combined, NULL);
+  combined.protocol = combiner->protocol;
+
+  for (bit_idx = 0; bit_idx < combined.protocol->data_bits; bit_idx++) {
+    // Confident bits outweigh the weak ones of the other frames
+    int16_t sum = combined_soft_bit(combiner, bit_idx);
+
+    if (sum == 0) {
+      // Tie, wait for another frame
+      return SL_STATUS_IN_PROGRESS;
+    }
+
+    (void) store_data_bit(&combined, sum > 0);
+  }
+
+  *packet = combined.data;
+
+  return SL_STATUS_OK;
+}
+
+void hcs300_codeword_pack(const hcs300_protocol_t *protocol,
+                          const hcs300_packet_t *packet,
+                          hcs300_codeword_t *codeword)
+{
+  // Button code bits: S3, S0, S1, S2 (LSB first)
+  uint32_t btn_code = packet->s3
+                      | (packet->s0 << 1)
+                      | (packet->s1 << 2)
+                      | (packet->s2 << 3);
+
+  memset(codeword, 0, sizeof(*codeword));
+  set_field(codeword, protocol->encrypted, packet->encrypted);
+  set_field(codeword, protocol->serial, packet->serial);
+  set_field(codeword, protocol->button, btn_code);
+  set_field(codeword, protocol->vlow, packet->vlow);
+  set_field(codeword, protocol->rpt, packet->rpt);
+  set_field(codeword, protocol->trailer, packet->trailer);
+}
+
+void hcs300_codeword_unpack(const hcs300_protocol_t *protocol,
+                            const hcs300_codeword_t *codeword,
+                            hcs300_packet_t *packet)
+{
+  uint32_t btn_code = get_field(codeword, protocol->button);
+
+  packet->encrypted = get_field(codeword, protocol->encrypted);
+  packet->serial = get_field(codeword, protocol->serial);
+  packet->s3 = btn_code & 1;
+  packet->s0 = (btn_code >> 1) & 1;
+  packet->s1 = (btn_code >> 2) & 1;
+  packet->s2 = (btn_code >> 3) & 1;
+  packet->vlow = get_field(codeword, protocol->vlow);
+  packet->rpt = get_field(codeword, protocol->rpt);
+  packet->trailer = get_field(codeword, protocol->trailer);
+}
+
+uint8_t hcs300_packet_btn_status(const hcs300_packet_t *packet)
+{
+  return packet->s0
+         | (packet->s1 << 1)
+         | (packet->s2 << 2)
+         | (packet->s3 << 3);
+}
+
+uint16_t hcs300_codeword_expand(const hcs300_protocol_t *protocol,
+                               const hcs300_codeword_t *codeword,
+                               uint16_t chips_per_te,
+                               uint8_t *chips,
+                               uint16_t chip_idx)
+{
+  const uint16_t *nibble_lut = get_nibble_lut(protocol, chips_per_te);
+  uint64_t data_bits;
+
+  if (nibble_lut != NULL) {
+    return expand_nibbles(chips, chip_idx, codeword, protocol->data_bits,
+                          protocol->bit_te, nibble_lut);
+  }
+
+  // Any other encoding or chip rate is built a level at a time
+  data_bits = codeword->word;
+  for (uint32_t data_bit_idx = 0; data_bit_idx < protocol->data_bits; data_bit_idx++) {
+    uint8_t data_bit = data_bits & 0x1;
+
+    // The tail follows the word
+    data_bits = (data_bit_idx == 8 * sizeof(codeword->word) - 1) ? codeword->tail : (data_bits >> 1);
+
+    switch (protocol->encoding) {
+      case HCS300_BIT_ENCODING_MANCHESTER:
+        // High then low half for a '1', low then high for a '0'
+        hcs300_chips_append_level(chips, &chip_idx, chips_per_te, data_bit != 0);
+        hcs300_chips_append_level(chips, &chip_idx, chips_per_te, data_bit == 0);
+        break;
+
+      case HCS300_BIT_ENCODING_VPWM: {
+        // Every bit is a level, the levels alternate starting with a high one
+        uint8_t level_te = (data_bit != 0) ? 1 : 2;
+        hcs300_chips_append_level(chips, &chip_idx, level_te * chips_per_te, (data_bit_idx & 1) == 0);
+        break;
+      }
+
+      default: {
+        // Short high level for a '1' (or for a '0' if inverted), long otherwise
+        uint8_t high_te = ((data_bit != 0) != (protocol->encoding == HCS300_BIT_ENCODING_PWM_INVERTED))
+                          ? 1
+                          : protocol->bit_te - 1;
+
+        hcs300_chips_append_level(chips, &chip_idx, high_te * chips_per_te, true);
+        hcs300_chips_append_level(chips, &chip_idx, (protocol->bit_te - high_te) * chips_per_te, false);
+        break;
+      }
+    }
+  }
+
+  return chip_idx;
+}
+
+void hcs300_chips_append_level(uint8_t *chips,
+                               uint16_t *chip_idx,
+                               uint16_t chip_cnt,
+                               bool high)
+{
+  // Low chips are cleared too, the chip array isn't cleared in advance
+  for (uint16_t chip_nr = 0; chip_nr < chip_cnt; chip_nr++, (*chip_idx)++) {
+    uint8_t chip_mask = (uint8_t)(1 << (*chip_idx & 0x7));
+
+    if (high) {
+      chips[*chip_idx >> 3] |= chip_mask;
+    } else {
+      chips[*chip_idx >> 3] &= (uint8_t) ~chip_mask;
+    }
+  }
+}
+
+void hcs300_chips_clear(uint8_t *chips, uint16_t chip_idx, uint16_t len)
+{
+  uint16_t byte_idx = chip_idx >> 3;
+
+  if ((chip_idx & 0x7) != 0) {
+    // Keep the chips below the index in the first byte
+    chips[byte_idx] &= (uint8_t)((1 << (chip_idx & 0x7)) - 1);
+    byte_idx++;
+  }
+  if (byte_idx < len) {
+    memset(&chips[byte_idx], 0, len - byte_idx);
+  }
+}
+
+static sl_status_t process_preamble_header(hcs300_decoder_t *decoder,
+                                           uint32_t duration)
+{
+  // The header can't be detected until the minimum number of preamble pulses
+  // (a high and a low level each except the last one) has been averaged.
+  if (decoder->preamble_capture_cnt + 1 >= 2 * decoder->config->min_preamble_pulses) {
+    // The jitter isn't known yet, the loose tolerance is used
+    if (is_within_rel_tolerance(duration,
+                                decoder->protocol->header_te * decoder->te_ticks,
+                                decoder->config->te_tolerance_init_pct)) {
+      // The header is zero so continue with data decoding
+      decoder->header_ticks = duration;
+      lock_te(decoder);
+      start_data(decoder);
+      if (decoder->protocol->encoding == HCS300_BIT_ENCODING_MANCHESTER
+          && 2 * duration > (2 * decoder->protocol->header_te + 1) * decoder->te_ticks) {
+        // The header is 1 TE longer, it ends with the low half of a '0'
+        return store_half_bit(decoder, false);
+      }
+      return SL_STATUS_IN_PROGRESS;
+    }
+  }
+
+  // Each level in preamble should be about 1 TE (50% duty cycle)
+  if (decoder->preamble_capture_cnt == 0 || duration < decoder->preamble_min_ticks) {
+    decoder->preamble_min_ticks = duration;
+  }
+  if (duration > decoder->preamble_max_ticks) {
+    decoder->preamble_max_ticks = duration;
+  }
+  decoder->te_ticks_sum += duration;
+  decoder->preamble_capture_cnt++;
+  decoder->te_ticks = decoder->te_ticks_sum / decoder->preamble_capture_cnt;
+
+  return SL_STATUS_IN_PROGRESS;
+}
+
+static sl_status_t process_first_bit(hcs300_decoder_t *decoder,
+                                     uint32_t duration)
+{
+  if (decoder->preamble_capture_cnt++ == 0) {
+    decoder->high_ticks = duration;
+    return SL_STATUS_IN_PROGRESS;
+  }
+
+  // No preamble, TE is locked to the period of the first bit (the sync pulse
+  // is too short to measure it on) and the tracking loop refines it
+  decoder->te_ticks = (decoder->high_ticks + duration) / decoder->protocol->bit_te;
+  lock_te(decoder);
+
+  return process_data_low(decoder, duration);
+}
+
+static sl_status_t process_data_low(hcs300_decoder_t *decoder,
+                                    uint32_t duration)
+{
+  uint8_t weak_bit_cnt = decoder->weak_bit_cnt;
+  uint8_t bit;
+  sl_status_t sc;
+
+  sc = decode_pwm(decoder, decoder->high_ticks, duration, &bit);
+  if (sc == SL_STATUS_OK) {
+    if (decoder->weak_bit_cnt == weak_bit_cnt) {
+      // Weak bits are too far off to correct TE with
+      track_te(decoder, decoder->high_ticks + duration);
+    }
+    sc = store_data_bit(decoder, bit);
+  }
+  if (sc == SL_STATUS_OK) {
+    decoder->state = HCS300_DECODER_STATE_DATA_HIGH;
+    sc = SL_STATUS_IN_PROGRESS;
+  }
+
+  return sc;
+}
+
+static sl_status_t process_trailing_sync(hcs300_decoder_t *decoder,
+                                         uint32_t duration)
+{
+  bool valid;
+
+  // Fixed-code frames are split at the sync low, the low level of the last
+  // bit and the pulse of the next sync may follow the data
+  if (decoder->protocol->sync_te == 0 || decoder->sync_level_cnt >= 2) {
+    valid = false;
+  } else if (decoder->sync_level_cnt == 0) {
+    valid = decoder->high_ticks + duration >= decoder->weak_bit_window.min_ticks
+            && decoder->high_ticks + duration <= decoder->weak_bit_window.max_ticks;
+  } else {
+    valid = is_within_tolerance(duration,
+                                decoder->protocol->sync_te * decoder->te_ticks,
+                                (uint32_t)(((uint64_t) decoder->protocol->sync_te
+                                            * decoder->te_ticks
+                                            * decoder->tolerance_q16) >> 16));
+  }
+
+  if (!valid) {
+    // Any other level after the last data bit means the codeword is longer
+    // than expected
+    decoder->state = HCS300_DECODER_STATE_ERROR;
+    return SL_STATUS_INVALID_COUNT;
+  }
+
+  decoder->sync_level_cnt++;
+
+  return decoder->status;
+}
+
+static sl_status_t process_data_level(hcs300_decoder_t *decoder,
+                                      uint32_t duration)
+{
+  hcs300_symbol_t symbol = quantize(decoder, duration);
+  bool high = decoder->level_high;
+  uint8_t te_cnt;
+  uint8_t bit;
+  sl_status_t sc;
+
+  decoder->level_high = !high;
+
+  // Both levels are compared against the windows, TE is tracked by shifts,
+  // so a frame is sliced in linear time without divisions
+  if (symbol == HCS300_SYMBOL_1TE) {
+    te_cnt = 1;
+  } else if (symbol == HCS300_SYMBOL_2TE) {
+    te_cnt = 2;
+  } else if (decoder->protocol->encoding == HCS300_BIT_ENCODING_VPWM) {
+    // Neither 1 TE nor 2 TE, the threshold is 1.5 TE (doubled to keep the
+    // scale of full bits)
+    decoder->soft_bits[decoder->data_bit_idx] =
+      soft_value(decoder, 3 * (int32_t) decoder->te_ticks - 2 * (int32_t) duration);
+    sc = decide_weak_bit(decoder, &decoder->weak_last_window, duration, &bit);
+    return (sc == SL_STATUS_OK) ? store_level_bit(decoder, bit) : sc;
+  } else {
+    return SL_STATUS_INVALID_RANGE;
+  }
+
+  track_te_level(decoder, duration, te_cnt);
+
+  if (decoder->protocol->encoding == HCS300_BIT_ENCODING_VPWM) {
+    decoder->soft_bits[decoder->data_bit_idx] = (te_cnt == 1) ? HCS300_SOFT_ONE_TE
+                                                              : -HCS300_SOFT_ONE_TE;
+    return store_level_bit(decoder, (te_cnt == 1) ? 1 : 0);
+  }
+
+  // A 2 TE Manchester level is the second half of a bit and the first half
+  // of the next one
+  sc = store_half_bit(decoder, high);
+  if (sc == SL_STATUS_IN_PROGRESS && te_cnt == 2) {
+    sc = store_half_bit(decoder, high);
+  }
+
+  return sc;
+}
+
+static sl_status_t store_half_bit(hcs300_decoder_t *decoder, bool high)
+{
+  if (decoder->data_bit_idx == decoder->protocol->data_bits) {
+    // Level after the last bit
+    return SL_STATUS_INVALID_COUNT;
+  }
+
+  if (!decoder->half_bit_pending) {
+    decoder->half_bit_pending = true;
+    decoder->half_bit_high = high;
+    if (high && decoder->data_bit_idx == decoder->protocol->data_bits - 1) {
+      // The low half of the last '1' is merged into the guard time
+      decoder->soft_bits[decoder->data_bit_idx] = HCS300_SOFT_ONE_TE;
+      return store_level_bit(decoder, 1);
+    }
+    return SL_STATUS_IN_PROGRESS;
+  }
+
+  decoder->half_bit_pending = false;
+  if (high == decoder->half_bit_high) {
+    // No transition in the middle of the bit
+    return SL_STATUS_INVALID_RANGE;
+  }
+
+  decoder->soft_bits[decoder->data_bit_idx] = decoder->half_bit_high ? HCS300_SOFT_ONE_TE
+                                                                     : -HCS300_SOFT_ONE_TE;
+  return store_level_bit(decoder, decoder->half_bit_high ? 1 : 0);
+}
+
+static sl_status_t store_level_bit(hcs300_decoder_t *decoder, uint8_t bit)
+{
+  sl_status_t sc = store_data_bit(decoder, bit);
+
+  if (sc != SL_STATUS_OK || !hcs300_decoder_is_soft_complete(decoder)) {
+    return (sc == SL_STATUS_OK) ? SL_STATUS_IN_PROGRESS : sc;
+  }
+
+  decoder->state = HCS300_DECODER_STATE_DONE;
+  if (decoder->weak_bit_cnt != 0) {
+    // Soft complete, only the combiner can make use of the frame
+    return SL_STATUS_INVALID_RANGE;
+  }
+
+  return SL_STATUS_OK;
+}
+
+static void start_data(hcs300_decoder_t *decoder)
+{
+  // The first data level is high, it follows the header gap
+  if (is_pwm(decoder->protocol)) {
+    decoder->state = HCS300_DECODER_STATE_DATA_HIGH;
+  } else {
+    decoder->state = HCS300_DECODER_STATE_DATA_LEVEL;
+    decoder->level_high = true;
+  }
+}
+
+static bool is_inverted(const hcs300_decoder_t *decoder)
+{
+  return decoder->protocol->encoding == HCS300_BIT_ENCODING_PWM_INVERTED;
+}
+
+static bool is_pwm(const hcs300_protocol_t *protocol)
+{
+  return protocol->encoding == HCS300_BIT_ENCODING_PWM
+         || protocol->encoding == HCS300_BIT_ENCODING_PWM_INVERTED;
+}
+
+static uint8_t long_te(const hcs300_protocol_t *protocol)
+{
+  return is_pwm(protocol) ? protocol->bit_te - 1 : 2;
+}
+
+static sl_status_t decode_pwm(hcs300_decoder_t *decoder,
+                              uint32_t high_duration,
+                              uint32_t low_duration,
+                              uint8_t *bit)
+{
+  hcs300_symbol_t high = quantize(decoder, high_duration);
+  hcs300_symbol_t low = quantize(decoder, low_duration);
+  int32_t distance_ticks = (int32_t) low_duration - (int32_t) high_duration;
+
+  // Equal levels are the threshold between a '0' (2 TE high, 1 TE low) and
+  // a '1' (1 TE high, 2 TE low), the other way around if inverted
+  decoder->soft_bits[decoder->data_bit_idx] =
+    soft_value(decoder, is_inverted(decoder) ? -distance_ticks : distance_ticks);
+
+  if (high == HCS300_SYMBOL_2TE && low == HCS300_SYMBOL_1TE) {
+    // Detected a long high bit
+    *bit = is_inverted(decoder) ? 1 : 0;
+  } else if (high == HCS300_SYMBOL_1TE && low == HCS300_SYMBOL_2TE) {
+    // Detected a short high bit
+    *bit = is_inverted(decoder) ? 0 : 1;
+  } else {
+    return decide_weak_bit(decoder,
+                           &decoder->weak_bit_window,
+                           high_duration + low_duration,
+                           bit);
+  }
+
+  return SL_STATUS_OK;
+}
+
+static sl_status_t decode_last_pwm(hcs300_decoder_t *decoder,
+                                   uint32_t high_duration,
+                                   uint8_t *bit)
+{
+  // The low level is not available so the bit is decided by the high level,
+  // the threshold is half of the bit period (doubled to keep the scale of
+  // full bits)
+  int32_t distance_ticks = (int32_t)(decoder->protocol->bit_te * decoder->te_ticks)
+                           - 2 * (int32_t) high_duration;
+
+  decoder->soft_bits[decoder->data_bit_idx] =
+    soft_value(decoder, is_inverted(decoder) ? -distance_ticks : distance_ticks);
+
+  switch (quantize(decoder, high_duration)) {
+    case HCS300_SYMBOL_2TE:
+      *bit = is_inverted(decoder) ? 1 : 0;
+      break;
+    case HCS300_SYMBOL_1TE:
+      *bit = is_inverted(decoder) ? 0 : 1;
+      break;
+    default:
+      return decide_weak_bit(decoder, &decoder->weak_last_window, high_duration, bit);
+  }
+
+  return SL_STATUS_OK;
+}
+
+static int8_t soft_value(const hcs300_decoder_t *decoder, int32_t distance_ticks)
+{
+  int32_t soft = (int32_t)(((int64_t) distance_ticks * decoder->soft_scale_q16) >> 16);
+
+  return (int8_t) SL_MIN(SL_MAX(soft, -INT8_MAX), INT8_MAX);
+}
+
+static sl_status_t decide_weak_bit(hcs300_decoder_t *decoder,
+                                   const hcs300_decoder_window_t *window,
+                                   uint32_t duration,
+                                   uint8_t *bit)
+{
+  int8_t soft = decoder->soft_bits[decoder->data_bit_idx];
+
+  // A bit period far off is rather noise or a lost edge than a weak bit
+  if (decoder->weak_bit_cnt >= decoder->config->max_weak_bits
+      || duration < window->min_ticks
+      || duration > window->max_ticks
+      || soft == 0) {
+    return SL_STATUS_INVALID_RANGE;
+  }
+
+  decoder->weak_bit_cnt++;
+  *bit = (soft > 0) ? 1 : 0;
+
+  return SL_STATUS_OK;
+}
+
+static sl_status_t store_data_bit(hcs300_decoder_t *decoder, uint8_t bit)
+{
+  // Data portion of code word - which starts after header - has the following structure: (66 bits)
+  // Note: multiple bits are sent in LSB first order
+  //   - Encrypted data: 32 bits
+  //   - Serial number: 28 bits
+  //   - Button code: 4 bits (s3,s0,s1,s2)
+  //   - VLOW: 1 bit
+  //   - RPT: 1 bit
+  // The first 64 bits are shifted into the word, the rest into the tail.
+  // Other protocols place their fields by the descriptor.
+  uint8_t data_bits = decoder->protocol->data_bits;
+
+  if (decoder->data_bit_idx < HCS300_CODEWORD_WORD_BITS) {
+    decoder->codeword.word = (decoder->codeword.word >> 1)
+                             | ((uint64_t) bit << (HCS300_CODEWORD_WORD_BITS - 1));
+  } else if (decoder->data_bit_idx < data_bits) {
+    decoder->codeword.tail |= (uint8_t)(bit << (decoder->data_bit_idx - HCS300_CODEWORD_WORD_BITS));
+  } else {
+    // Should not happen
+    return SL_STATUS_INVALID_RANGE;
+  }
+  decoder->data_bit_idx++;
+
+  if (decoder->data_bit_idx == data_bits) {
+    if (data_bits < HCS300_CODEWORD_WORD_BITS) {
+      // The first bit shall be the LSB of a shorter word too
+      decoder->codeword.word >>= HCS300_CODEWORD_WORD_BITS - data_bits;
+    }
+    hcs300_codeword_unpack(decoder->protocol, &decoder->codeword, &decoder->data);
+  }
+
+  return SL_STATUS_OK;
+}
+
+static void record_level(hcs300_decoder_t *decoder,
+                         hcs300_decoder_state_t prev_state,
+                         uint32_t duration)
+{
+  hcs300_symbol_frame_t *record = decoder->record;
+
+  if (record == NULL) {
+    return;
+  }
+
+  record->protocol = decoder->protocol;
+  if (prev_state == HCS300_DECODER_STATE_PREAMBLE) {
+    // TE is not locked yet, keep the raw duration. The last two levels may
+    // be several TE long (header, first bit of fixed-code frames), they are
+    // kept at full range, the earlier ones are 1 TE preamble levels.
+    if (decoder->state != HCS300_DECODER_STATE_PREAMBLE) {
+      record->lock_ticks[1] = duration;
+      return;
+    }
+    if (record->lock_ticks[0] != 0
+        && record->preamble_len < HCS300_PREAMBLE_TE - 1) {
+      record->preamble[record->preamble_len++] = (uint16_t) SL_MIN(record->lock_ticks[0], UINT16_MAX);
+    }
+    record->lock_ticks[0] = duration;
+    return;
+  }
+
+  if (record->symbol_len < HCS300_SYMBOL_FRAME_SYMBOLS) {
+    uint8_t shift = (record->symbol_len % HCS300_SYMBOLS_PER_BYTE) * HCS300_SYMBOL_BITS;
+    record->symbols[record->symbol_len / HCS300_SYMBOLS_PER_BYTE] |=
+      (uint8_t)(quantize(decoder, duration) << shift);
+    record->symbol_len++;
+    record->te_ticks = decoder->te_ticks;
+  }
+}
+
+static sl_status_t resync_at(hcs300_decoder_t *decoder,
+                             const uint32_t *levels,
+                             uint16_t data_idx)
+{
+  const hcs300_decoder_config_t *config = decoder->config;
+  const hcs300_protocol_t *protocol = decoder->protocol;
+  hcs300_symbol_frame_t *record = decoder->record;
+  const uint32_t *data = &levels[data_idx];
+  uint8_t full_bits = protocol->data_bits - 1;
+  uint32_t period_sum = 0;
+  uint32_t period_min = UINT32_MAX;
+  uint32_t period_max = 0;
+  sl_status_t sc = SL_STATUS_IN_PROGRESS;
+  uint16_t level_idx;
+
+  // Every full bit (high and low level) is bit_te long, the last one has no low
+  for (level_idx = 0; level_idx < 2 * full_bits; level_idx += 2) {
+    uint32_t period = data[level_idx] + data[level_idx + 1];
+    period_sum += period;
+    period_min = SL_MIN(period_min, period);
+    period_max = SL_MAX(period_max, period);
+  }
+
+  hcs300_decoder_reset(decoder, config);
+  decoder->protocol = protocol;
+  hcs300_decoder_set_record(decoder, record);
+
+  // The spread of the bit periods stands for the jitter of the preamble
+  decoder->te_ticks = period_sum / (protocol->bit_te * full_bits);
+  decoder->preamble_min_ticks = period_min;
+  decoder->preamble_max_ticks = period_max;
+  decoder->preamble_capture_cnt = (data_idx > 0) ? data_idx - 1 : 0;
+  lock_te(decoder);
+
+  decoder->sync = HCS300_SYNC_DATA;
+  decoder->state = HCS300_DECODER_STATE_DATA_HIGH;
+  if (data_idx > 0) {
+    decoder->header_ticks = levels[data_idx - 1];
+    if (quantize(decoder, decoder->header_ticks) == HCS300_SYMBOL_HEADER) {
+      decoder->sync = HCS300_SYNC_HEADER;
+    }
+  }
+  if (record != NULL) {
+    // The preamble is lost, a TE level and the header (nominal if lost too)
+    // stand for it in the replay
+    record->lock_ticks[0] = decoder->te_ticks;
+    record->lock_ticks[1] = (data_idx > 0) ? decoder->header_ticks
+                                           : protocol->header_te * decoder->te_ticks;
+  }
+
+  for (level_idx = 0; level_idx < 2 * full_bits + 1 && sc == SL_STATUS_IN_PROGRESS; level_idx++) {
+    sc = hcs300_decoder_feed(decoder, data[level_idx]);
+  }
+
+  return sc;
+}
+
+static void lock_te(hcs300_decoder_t *decoder)
+{
+  uint32_t spread_pct = 0;
+  uint32_t init_tolerance;
+  uint32_t bit_ticks;
+
+  // Peak-to-peak spread of the preamble levels relative to TE covers the
+  // jitter in both directions, used as tolerance within the configured range.
+  // Without preamble the jitter is unknown, the loose tolerance is used.
+  if (decoder->protocol->preamble_te == 0) {
+    spread_pct = decoder->config->te_tolerance_init_pct;
+  } else if (decoder->te_ticks != 0) {
+    spread_pct = ((decoder->preamble_max_ticks - decoder->preamble_min_ticks) * 100
+                  + decoder->te_ticks - 1) / decoder->te_ticks;
+  }
+  decoder->tolerance_pct = (uint8_t) SL_MIN(SL_MAX(spread_pct,
+                                                   decoder->config->te_tolerance_prec_pct),
+                                            SL_MIN(decoder->config->te_tolerance_init_pct,
+                                                   decoder->protocol->te_tolerance_max_pct));
+
+  // The only divisions of the frame, the windows are updated by multiplications
+  decoder->tolerance_q16 = ((uint32_t) decoder->tolerance_pct << 16) / 100;
+  decoder->bit_te_recip_q24 = (1UL << 24) / decoder->protocol->bit_te;
+  decoder->te_lock_ticks = decoder->te_ticks;
+  decoder->te_q8 = decoder->te_ticks << 8;
+  if (decoder->te_ticks != 0) {
+    decoder->soft_scale_q16 = (HCS300_SOFT_ONE_TE << 16) / decoder->te_ticks;
+  }
+
+  // Weak bits shall still have the bit period (3 TE) and a high level between
+  // the short and the long level within the loose tolerance, kept at the
+  // locked TE
+  bit_ticks = decoder->protocol->bit_te * decoder->te_ticks;
+  init_tolerance = bit_ticks * decoder->config->te_tolerance_init_pct / 100;
+  decoder->weak_bit_window.min_ticks = bit_ticks - init_tolerance;
+  decoder->weak_bit_window.max_ticks = bit_ticks + init_tolerance;
+  init_tolerance = decoder->te_ticks * decoder->config->te_tolerance_init_pct / 100;
+  decoder->weak_last_window.min_ticks = decoder->te_ticks - init_tolerance;
+  decoder->weak_last_window.max_ticks = long_te(decoder->protocol)
+                                        * (decoder->te_ticks + init_tolerance);
+
+  update_windows(decoder);
+}
+
+static void track_te(hcs300_decoder_t *decoder, uint32_t bit_duration)
+{
+  uint8_t shift = decoder->config->te_tracking_shift;
+  int32_t error_q8;
+
+  if (shift == 0) {
+    return;
+  }
+
+  // First-order loop on the 3 TE bit period (high + low level) of every
+  // accepted bit. The error is bounded by the windows, so is the step. The
+  // period is divided by bit_te with the reciprocal of the frame.
+  error_q8 = (int32_t)(((uint64_t) bit_duration * decoder->bit_te_recip_q24) >> 16)
+             - (int32_t) decoder->te_q8;
+  decoder->te_q8 = (uint32_t)((int32_t) decoder->te_q8 + (error_q8 >> shift));
+  decoder->te_ticks = (decoder->te_q8 + 128) >> 8;
+
+  update_windows(decoder);
+}
+
+static void track_te_level(hcs300_decoder_t *decoder, uint32_t duration, uint8_t te_cnt)
+{
+  uint8_t shift = decoder->config->te_tracking_shift;
+  int32_t error_q8;
+
+  if (shift == 0) {
+    return;
+  }
+
+  // Same loop on a single level of 1 TE or 2 TE, scaled by a shift
+  error_q8 = (int32_t)((duration << 8) >> (te_cnt - 1)) - (int32_t) decoder->te_q8;
+  decoder->te_q8 = (uint32_t)((int32_t) decoder->te_q8 + (error_q8 >> shift));
+  decoder->te_ticks = (decoder->te_q8 + 128) >> 8;
+
+  update_windows(decoder);
+}
+
+static void update_windows(hcs300_decoder_t *decoder)
+{
+  const uint8_t symbol_te[HCS300_SYMBOL_INVALID] = {
+    [HCS300_SYMBOL_1TE] = 1,
+    [HCS300_SYMBOL_2TE] = long_te(decoder->protocol),
+    [HCS300_SYMBOL_HEADER] = decoder->protocol->header_te,
+  };
+  uint8_t symbol;
+
+  for (symbol = 0; symbol < HCS300_SYMBOL_INVALID; symbol++) {
+    uint32_t target = symbol_te[symbol] * decoder->te_ticks;
+    uint32_t tolerance = (uint32_t)(((uint64_t) target * decoder->tolerance_q16) >> 16);
+
+    decoder->windows[symbol].min_ticks = target - tolerance;
+    decoder->windows[symbol].max_ticks = target + tolerance;
+  }
+}
+
+static hcs300_symbol_t quantize(const hcs300_decoder_t *decoder, uint32_t duration)
+{
+  uint8_t symbol;
+
+  for (symbol = 0; symbol < HCS300_SYMBOL_INVALID; symbol++) {
+    if (duration >= decoder->windows[symbol].min_ticks
+        && duration <= decoder->windows[symbol].max_ticks) {
+      return (hcs300_symbol_t) symbol;
+    }
+  }
+  return HCS300_SYMBOL_INVALID;
+}
+
+static uint32_t get_field(const hcs300_codeword_t *codeword, hcs300_field_t field)
+{
+  uint32_t value;
+
+  if (field.bits == 0) {
+    // Not present in the protocol
+    return 0;
+  }
+
+  if (field.offset >= HCS300_CODEWORD_WORD_BITS) {
+    value = codeword->tail >> (field.offset - HCS300_CODEWORD_WORD_BITS);
+  } else {
+    value = (uint32_t)(codeword->word >> field.offset);
+    if (field.offset + field.bits > HCS300_CODEWORD_WORD_BITS) {
+      // Continues in the tail
+      value |= (uint32_t) codeword->tail << (HCS300_CODEWORD_WORD_BITS - field.offset);
+    }
+  }
+
+  return (field.bits < 32) ? (value & ((1UL << field.bits) - 1)) : value;
+}
+
+static void set_field(hcs300_codeword_t *codeword, hcs300_field_t field, uint32_t value)
+{
+  if (field.bits == 0) {
+    return;
+  }
+  if (field.bits < 32) {
+    value &= (1UL << field.bits) - 1;
+  }
+
+  if (field.offset >= HCS300_CODEWORD_WORD_BITS) {
+    codeword->tail |= (uint8_t)(value << (field.offset - HCS300_CODEWORD_WORD_BITS));
+  } else {
+    codeword->word |= (uint64_t) value << field.offset;
+    if (field.offset + field.bits > HCS300_CODEWORD_WORD_BITS) {
+      codeword->tail |= (uint8_t)(value >> (HCS300_CODEWORD_WORD_BITS - field.offset));
+    }
+  }
+}
+
+static bool is_within_tolerance(uint32_t value,
+                                uint32_t target,
+                                uint32_t tolerance)
+{
+  return (value >= (target - tolerance)) && (value <= (target + tolerance));
+}
+
+static bool is_within_rel_tolerance(uint32_t value,
+                                    uint32_t target,
+                                    uint8_t rel_tolerance_pct)
+{
+  uint32_t tolerance = (target * rel_tolerance_pct) / 100;
+  return is_within_tolerance(value, target, tolerance);
+}
+
+static const uint16_t *get_nibble_lut(const hcs300_protocol_t *protocol,
+                                      uint16_t chips_per_te)
+{
+  if (chips_per_te != 1) {
+    return NULL;
+  }
+  if (protocol->encoding == HCS300_BIT_ENCODING_PWM && protocol->bit_te == 3) {
+    return hcs300_pwm3_nibble_lut;
+  }
+  if (protocol->encoding == HCS300_BIT_ENCODING_PWM_INVERTED && protocol->bit_te == 4) {
+    return hcs300_pwm4_inv_nibble_lut;
+  }
+  return NULL;
+}
+
+static uint16_t expand_nibbles(uint8_t *chips,
+                               uint16_t chip_idx,
+                               const hcs300_codeword_t *codeword,
+                               uint8_t data_bits,
+                               uint8_t bit_te,
+                               const uint16_t *lut)
+{
+  uint16_t byte_idx = chip_idx >> 3;
+  uint8_t chip_cnt = chip_idx & 0x7;
+  // Chips already written to the first byte are stored again with the data
+  uint64_t chip_acc = chips[byte_idx] & ((1U << chip_cnt) - 1);
+
+  for (uint8_t data_bit_idx = 0; data_bit_idx < data_bits; data_bit_idx += 4) {
+    // The word holds a whole number of nibbles, the tail follows it
+    uint8_t nibble = (data_bit_idx < 8 * sizeof(codeword->word))
+                     ? (uint8_t)(codeword->word >> data_bit_idx) & 0xF
+                     : (uint8_t)(codeword->tail >> (data_bit_idx - 8 * sizeof(codeword->word))) & 0xF;
+    uint8_t nibble_chips = SL_MIN(4, data_bits - data_bit_idx) * bit_te;
+
+    chip_acc |= (uint64_t)(lut[nibble] & ((1UL << nibble_chips) - 1)) << chip_cnt;
+    chip_cnt += nibble_chips;
+
+    if (chip_cnt >= 32) {
+      // Little-endian word store, the byte order of the chip array
+      uint32_t chip_word = (uint32_t) chip_acc;
+      memcpy(&chips[byte_idx], &chip_word, sizeof(chip_word));
+      byte_idx += sizeof(chip_word);
+      chip_acc >>= 32;
+      chip_cnt -= 32;
+    }
+  }
+
+  chip_idx = 8 * byte_idx + chip_cnt;
+  for (; chip_cnt > 0; chip_cnt = (chip_cnt > 8) ? chip_cnt - 8 : 0) {
+    chips[byte_idx++] = (uint8_t) chip_acc;
+    chip_acc >>= 8;
+  }
+
+  return chip_idx;
+}
+
+static int16_t combined_soft_bit(const hcs300_combiner_t *combiner, uint8_t bit_idx)
+{
+  int16_t sum = 0;
+  uint8_t frame_idx;
+
+  for (frame_idx = 0; frame_idx < combiner->frame_cnt; frame_idx++) {
+    sum += combiner->soft_bits[frame_idx][bit_idx];
+  }
+  return sum;
+}
+
+static bool is_same_press(const hcs300_combiner_t *combiner,
+                          const hcs300_decoder_t *decoder)
+{
+  // The serial number and the button code are the same in every frame of a
+  // press, only weak bits of them may be decided differently
+  const hcs300_field_t fixed_fields[] = {
+    decoder->protocol->serial,
+    decoder->protocol->button,
+  };
+  uint8_t field_idx;
+
+  for (field_idx = 0; field_idx < sizeof(fixed_fields) / sizeof(fixed_fields[0]); field_idx++) {
+    hcs300_field_t field = fixed_fields[field_idx];
+    uint8_t bit_idx;
+
+    for (bit_idx = field.offset; bit_idx < field.offset + field.bits; bit_idx++) {
+      int16_t combined = combined_soft_bit(combiner, bit_idx);
+      int16_t soft_bit = decoder->soft_bits[bit_idx];
+
+      if ((combined >= HCS300_COMBINER_MISMATCH_SOFT && soft_bit <= -HCS300_COMBINER_MISMATCH_SOFT)
+          || (combined <= -HCS300_COMBINER_MISMATCH_SOFT && soft_bit >= HCS300_COMBINER_MISMATCH_SOFT)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,415 @@
+#ifndef HCS300_DECODER_H
+#define HCS300_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sl_status.h"
+
+#include "hcs300.h"
+
+// Incremental HCS300 codeword decoder.
+// The decoder takes the duration of one level (the time between two edges)
+// at a time, so it can be fed directly from the capture ISR or from a buffer
+// of captures. The first capture of a frame (always zero, the timer is
+// started by the first edge) shall not be fed.
+// Level durations after the first edge:
+//   - Preamble: 23 levels of 1 TE, the average gives the TE estimate
+//   - Header: 1 level of 10 TE
+//   - Data: 66 high levels and 65 low levels, the last low level is followed
+//     by the guard time so it isn't captured. The last bit is decoded from
+//     its high level only.
+
+// The tolerance of the data levels is picked per frame from the spread of the
+// preamble levels, it is kept between te_tolerance_prec_pct (clean signal)
+// and te_tolerance_init_pct. The latter is also used to detect the header
+// while TE is not locked yet.
+typedef struct hcs300_decoder_config {
+  uint8_t min_preamble_pulses;
+  uint8_t te_tolerance_init_pct;
+  uint8_t te_tolerance_prec_pct;
+  // TE tracking loop gain is 1 / 2^shift, 0 keeps TE locked at the preamble
+  uint8_t te_tracking_shift;
+  // Bits outside of the tolerance but with a plausible bit period are decided
+  // by their soft value, up to this many in a frame (0 disables). Such a frame
+  // isn't accepted on its own, it can only be combined with repeated frames.
+  uint8_t max_weak_bits;
+} hcs300_decoder_config_t;
+
+// Protocol descriptor.
+// Encoders of the KEELOQ family send a preamble, a header gap and the data
+// bits with the same structure, they differ in the frame layout. Fixed-code
+// encoders (EV1527, PT2262) send a sync (a short pulse and a long low) and
+// the data bits with another PWM shape. The decoder is driven by the
+// descriptor of the protocol, timings are in TE and field offsets in data
+// bits (transmission order).
+// Every PWM bit is a 1 TE and a bit_te - 1 TE long level. Manchester and
+// VPWM bits (HCS361, HCS362) are made of 1 TE and 2 TE levels.
+typedef enum hcs300_bit_encoding {
+  // '0': long high short low, '1': short high long low (KEELOQ)
+  HCS300_BIT_ENCODING_PWM,
+  // '0': short high long low, '1': long high short low (EV1527, PT2262)
+  HCS300_BIT_ENCODING_PWM_INVERTED,
+  // '0': 1 TE low 1 TE high, '1': 1 TE high 1 TE low (bit_te is 2). The low
+  // half of a leading '0' is merged into the header.
+  HCS300_BIT_ENCODING_MANCHESTER,
+  // Every level is a bit, '0': 2 TE, '1': 1 TE (bit_te is 2). The first bit
+  // is a high level, the number of bits shall be odd so that the last one is
+  // a high level too (the guard time follows it).
+  HCS300_BIT_ENCODING_VPWM,
+} hcs300_bit_encoding_t;
+
+// Field of the data portion, zero bits if the protocol doesn't have it
+typedef struct hcs300_field {
+  uint8_t offset;
+  uint8_t bits;
+} hcs300_field_t;
+
+struct hcs300_protocol {
+  const char *name;
+  hcs300_bit_encoding_t encoding;
+  // Zero for fixed-code protocols, TE is estimated from the first bit
+  uint8_t preamble_te;
+  // Gap in front of the data, the low of the sync for fixed-code protocols
+  uint8_t header_te;
+  // High pulse of the sync of fixed-code protocols, zero if none. The frames
+  // of a burst are split at the sync low, so the low of the last bit and the
+  // pulse of the next sync trail the data.
+  uint8_t sync_te;
+  uint8_t bit_te;
+  uint8_t data_bits;
+  // Upper bound of the data tolerance given by the timing specification
+  uint8_t te_tolerance_max_pct;
+  hcs300_field_t encrypted;
+  hcs300_field_t serial;
+  // Button code S3, S0, S1, S2 (LSB first)
+  hcs300_field_t button;
+  hcs300_field_t vlow;
+  hcs300_field_t rpt;
+  // Bits after VLOW (CRC and queue bits of HCS361 and HCS362), relayed as
+  // received
+  hcs300_field_t trailer;
+};
+
+// Longest data portion of the supported protocols, sizes the buffers
+#define HCS300_PROTOCOL_MAX_DATA_BITS HCS362_DATA_BITS
+
+// Levels of the longest frame: preamble, header and 2 levels per data bit
+// (Manchester, PWM without the trailing low). Fixed-code frames are shorter
+// even with the trailing sync levels.
+#define HCS300_PROTOCOL_MAX_LEVELS    (HCS300_PREAMBLE_TE + 1 \
+                                       + 2 * HCS300_PROTOCOL_MAX_DATA_BITS)
+
+// HCS200, HCS201, HCS300 and HCS301 (66 data bits, PWM)
+extern const hcs300_protocol_t hcs300_protocol_keeloq_pwm;
+// 20 bit address and 4 data bits
+extern const hcs300_protocol_t hcs300_protocol_ev1527;
+// 12 trits, each sent as two bits ('0': 00, '1': 11, 'F': 01), kept raw in
+// the serial field. The line code is the same as of EV1527, only one of them
+// can be told apart in a registry.
+extern const hcs300_protocol_t hcs300_protocol_pt2262;
+// HCS361 (67 data bits) and HCS362 (69 data bits) with Manchester or VPWM
+// bits, the CRC and queue bits aren't part of the packet. With PWM bits they
+// have the KEELOQ layout with longer data.
+extern const hcs300_protocol_t hcs300_protocol_hcs361_manchester;
+extern const hcs300_protocol_t hcs300_protocol_hcs361_vpwm;
+extern const hcs300_protocol_t hcs300_protocol_hcs362_manchester;
+extern const hcs300_protocol_t hcs300_protocol_hcs362_vpwm;
+extern const hcs300_protocol_t hcs300_protocol_hcs362_pwm;
+
+typedef struct hcs300_packet {
+  uint32_t encrypted;
+  uint32_t serial : 28;
+  uint8_t s3 : 1;
+  uint8_t s0 : 1;
+  uint8_t s1 : 1;
+  uint8_t s2 : 1;
+  uint8_t vlow : 1;
+  uint8_t rpt : 1;
+  uint8_t trailer : 4;
+} hcs300_packet_t;
+
+// Packed data portion of the code word, shared by the decoder and the
+// encoder. Bits are in transmission order (LSB first), the first 64 bits are
+// in the word and the rest in the tail. With the KEELOQ PWM layout the word
+// holds the encrypted portion (bits 0-31), the serial number (32-59) and the
+// button code S3, S0, S1, S2 (60-63), the tail holds VLOW (bit 0) and RPT
+// (bit 1).
+typedef struct hcs300_codeword {
+  uint64_t word;
+  uint8_t  tail;
+} hcs300_codeword_t;
+
+// Quantized frame representation.
+// Once TE is locked by the header detection every level is stored as a 2 bit
+// symbol instead of the raw duration, only the preamble levels (TE estimate)
+// and the header are kept raw. A frame takes 100 bytes on the 32-bit target
+// instead of the 4 bytes per capture of the raw frames, so a
+// deep history of frames can be kept.
+typedef enum hcs300_symbol {
+  // Short and long data levels (1 TE and bit_te - 1 TE)
+  HCS300_SYMBOL_1TE,
+  HCS300_SYMBOL_2TE,
+  HCS300_SYMBOL_HEADER,
+  HCS300_SYMBOL_INVALID,
+} hcs300_symbol_t;
+
+#define HCS300_SYMBOL_BITS            2
+#define HCS300_SYMBOLS_PER_BYTE       (8 / HCS300_SYMBOL_BITS)
+
+// Data levels of the longest frame, the preamble and the level locking TE
+// (header) are kept raw
+#define HCS300_SYMBOL_FRAME_SYMBOLS   (HCS300_PROTOCOL_MAX_LEVELS - HCS300_PREAMBLE_TE - 1)
+
+struct hcs300_symbol_frame {
+  // Protocol of the decoder which recorded the frame, the symbols are in its
+  // TE units (long level and header)
+  const hcs300_protocol_t *protocol;
+  uint32_t te_ticks;
+  // The two levels locking TE in timer ticks: the last preamble level and
+  // the header, or both levels of the first bit of fixed-code frames. The
+  // second one is zero if TE hasn't been locked.
+  uint32_t lock_ticks[2];
+  // Raw preamble levels before them in timer ticks, 1 TE long (saturated)
+  uint16_t preamble[HCS300_PREAMBLE_TE - 1];
+  uint8_t  preamble_len;
+  uint8_t  symbol_len;
+  uint8_t  symbols[(HCS300_SYMBOL_FRAME_SYMBOLS + HCS300_SYMBOLS_PER_BYTE - 1)
+                   / HCS300_SYMBOLS_PER_BYTE];
+};
+
+// Glitch filter stage in front of the decoder.
+// A level shorter than the minimum width is a spike, it is merged together
+// with the level before and after it into one level (the spike splits a
+// level into three). The filter holds back one level until the next one
+// shows whether it is followed by a spike, so the last level of a frame
+// shall be flushed at the end of frame. Minimum width zero disables the
+// filter, every level is passed through immediately.
+typedef enum hcs300_glitch_filter_state {
+  HCS300_GLITCH_FILTER_STATE_EMPTY,
+  HCS300_GLITCH_FILTER_STATE_PENDING,
+  HCS300_GLITCH_FILTER_STATE_GLITCH,
+} hcs300_glitch_filter_state_t;
+
+typedef struct hcs300_glitch_filter {
+  uint32_t min_ticks;
+  uint32_t pending_ticks;
+  hcs300_glitch_filter_state_t state;
+  uint16_t glitch_cnt;
+} hcs300_glitch_filter_t;
+
+typedef enum hcs300_decoder_state {
+  HCS300_DECODER_STATE_PREAMBLE,
+  HCS300_DECODER_STATE_DATA_HIGH,
+  HCS300_DECODER_STATE_DATA_LOW,
+  // Manchester and VPWM, every level is sliced on its own
+  HCS300_DECODER_STATE_DATA_LEVEL,
+  HCS300_DECODER_STATE_DONE,
+  HCS300_DECODER_STATE_ERROR,
+} hcs300_decoder_state_t;
+
+// Accepted level durations in ticks
+typedef struct hcs300_decoder_window {
+  uint32_t min_ticks;
+  uint32_t max_ticks;
+} hcs300_decoder_window_t;
+
+typedef struct hcs300_decoder {
+  const hcs300_decoder_config_t *config;
+  const hcs300_protocol_t *protocol;
+  hcs300_symbol_frame_t *record;
+  // Computed when TE is locked (header detected) and when the tracking loop
+  // updates TE, indexed by symbol. Data levels are classified by plain
+  // comparisons against them.
+  hcs300_decoder_window_t windows[HCS300_SYMBOL_INVALID];
+  uint32_t tolerance_q16;
+  uint8_t  tolerance_pct;
+  // Plausible bit period (high and low level) and last high level of weak
+  // bits, and the scale of the soft values (64 is 1 TE off the threshold)
+  hcs300_decoder_window_t weak_bit_window;
+  hcs300_decoder_window_t weak_last_window;
+  uint32_t soft_scale_q16;
+  int8_t   soft_bits[HCS300_PROTOCOL_MAX_DATA_BITS];
+  uint8_t  weak_bit_cnt;
+  // TE tracked over the data bits in 1/256 ticks, te_ticks follows it
+  uint32_t te_q8;
+  // 1 / bit_te in 1/2^24, the tracking loop multiplies instead of dividing
+  uint32_t bit_te_recip_q24;
+  uint32_t te_lock_ticks;
+  // Bits are shifted in from the top of the word (LSB first), the fields of
+  // data are extracted once the last bit has arrived
+  hcs300_codeword_t codeword;
+  hcs300_packet_t data;
+  hcs300_decoder_state_t state;
+  sl_status_t status;
+  uint32_t te_ticks;
+  uint32_t te_ticks_sum;
+  uint32_t preamble_min_ticks;
+  uint32_t preamble_max_ticks;
+  uint32_t header_ticks;
+  uint32_t high_ticks;
+  uint16_t preamble_capture_cnt;
+  uint8_t  data_bit_idx;
+  // Levels accepted after the last data bit (fixed-code sync)
+  uint8_t  sync_level_cnt;
+  // Polarity of the next data level and the first half of the Manchester
+  // bit in progress
+  bool     level_high;
+  bool     half_bit_pending;
+  bool     half_bit_high;
+  hcs300_sync_t sync;
+} hcs300_decoder_t;
+
+// The protocol is reset to KEELOQ PWM
+void hcs300_decoder_reset(hcs300_decoder_t *decoder,
+                          const hcs300_decoder_config_t *config);
+
+// Select the protocol of the frame, shall be called after reset. Returns
+// SL_STATUS_NOT_SUPPORTED if the decoder can't handle its layout.
+sl_status_t hcs300_decoder_set_protocol(hcs300_decoder_t *decoder,
+                                        const hcs300_protocol_t *protocol);
+
+// Fewest levels a frame of the protocol can be decoded from: the data levels
+// alone (resync doesn't need the preamble and the header), the first and the
+// last one may be merged into the header and the guard time
+uint16_t hcs300_protocol_min_levels(const hcs300_protocol_t *protocol);
+
+// Returns SL_STATUS_IN_PROGRESS while more levels are needed, SL_STATUS_OK
+// when the packet is complete (the last data bit has been decoded) and an
+// error code if the codeword is invalid. Both completion and error are
+// sticky until the decoder is reset. A soft complete frame with weak bits is
+// done too (SL_STATUS_INVALID_RANGE), the trailing sync levels of fixed-code
+// frames keep the result.
+sl_status_t hcs300_decoder_feed(hcs300_decoder_t *decoder, uint32_t duration);
+
+// Resynchronize to a frame whose preamble or header is damaged. The data
+// levels are searched backward from the end of the levels of a complete
+// frame (the last one is the high level of the last bit, a few trailing
+// levels are skipped), TE is derived from the data bit periods. The decoder
+// is reset (the record is kept) and the data levels are fed to it, the
+// result is the same as of hcs300_decoder_feed() at the end of frame. The
+// recovery path is reported in sync. Only PWM encodings have a fixed number of
+// data levels, SL_STATUS_NOT_SUPPORTED is returned for the others.
+sl_status_t hcs300_decoder_resync(hcs300_decoder_t *decoder,
+                                  const uint32_t *levels,
+                                  uint16_t level_cnt);
+
+// Record the quantized levels of the frame being decoded into the given
+// symbol frame (NULL to stop recording). Shall be called after reset.
+void hcs300_decoder_set_record(hcs300_decoder_t *decoder,
+                               hcs300_symbol_frame_t *record);
+
+hcs300_symbol_t hcs300_symbol_frame_get(const hcs300_symbol_frame_t *frame,
+                                        uint8_t symbol_idx);
+
+// Decode a packet from a recorded symbol frame. The levels are replayed to a
+// decoder of the recording protocol: the raw levels, the level locking TE,
+// then each symbol as its TE multiple. Weak levels (invalid symbols) fail the frame.
+sl_status_t hcs300_symbol_frame_decode(const hcs300_symbol_frame_t *frame,
+                                       hcs300_packet_t *packet);
+
+void hcs300_glitch_filter_reset(hcs300_glitch_filter_t *filter, uint32_t min_ticks);
+
+// Returns true if a filtered level is available in level
+bool hcs300_glitch_filter_feed(hcs300_glitch_filter_t *filter,
+                               uint32_t duration,
+                               uint32_t *level);
+
+// Returns true if the held back level is available in level
+bool hcs300_glitch_filter_flush(hcs300_glitch_filter_t *filter, uint32_t *level);
+
+// Every data bit has been decided (soft_bits are complete), even if the frame
+// failed because of weak bits
+bool hcs300_decoder_is_soft_complete(const hcs300_decoder_t *decoder);
+
+// TE classification.
+// The encoder can be programmed to a TE of 100, 200 or 400 us, a measured TE
+// is matched to the nearest one. The classes are a factor of 2 apart, so the
+// boundaries are at their geometric mean (factor of sqrt(2)) and a TE more
+// than that off the shortest or the longest class is invalid.
+typedef enum hcs300_te_class {
+  HCS300_TE_CLASS_100US,
+  HCS300_TE_CLASS_200US,
+  HCS300_TE_CLASS_400US,
+  HCS300_TE_CLASS_INVALID,
+} hcs300_te_class_t;
+
+#define HCS300_TE_CLASS_US(te_class)  (100U << (te_class))
+
+// Classify a TE given the ticks of the shortest class (100 us), no division
+hcs300_te_class_t hcs300_te_classify(uint32_t te_ticks, uint32_t te_100us_ticks);
+
+// TE a received packet is relayed with on a PHY with a bit period (chip) of
+// chip_us. Packets of protocols with a preamble are relayed with the TE
+// setting of the encoder (te_nominal_us, zero if it wasn't detected), the
+// other ones with the measured TE. Every TE is sent as a whole number of
+// chips: the TE is rounded to the nearest multiple, a TE shorter than a chip
+// is sent as one chip (the receivers take TE from the frame). Zero if the
+// packet can't be relayed (no bit period).
+uint16_t hcs300_relay_te_us(const hcs300_protocol_t *protocol,
+                            uint32_t te_nominal_us,
+                            uint32_t te_measured_us,
+                            uint16_t chip_us);
+
+// Drift of TE during the data portion relative to the TE locked at the
+// preamble in ppm (positive when the bits get longer)
+int32_t hcs300_decoder_te_drift_ppm(const hcs300_decoder_t *decoder);
+
+// Soft combiner of repeated frames.
+// The soft bits of the last frames with the same preamble TE are summed, the
+// sign of the sum decides each bit (weighted majority vote). It recovers the
+// codeword from repeated frames which fail on their own. A frame whose serial
+// number or button code contradicts the stored frames (confident bits decided
+// the other way) restarts the history, so does the caller at the end of a
+// press (the idle gap before the next one).
+#ifndef HCS300_COMBINER_DEPTH
+#define HCS300_COMBINER_DEPTH         4
+#endif
+
+typedef struct hcs300_combiner {
+  int8_t   soft_bits[HCS300_COMBINER_DEPTH][HCS300_PROTOCOL_MAX_DATA_BITS];
+  const hcs300_protocol_t *protocol;
+  uint32_t te_ticks;
+  uint8_t  head;
+  uint8_t  frame_cnt;
+} hcs300_combiner_t;
+
+void hcs300_combiner_reset(hcs300_combiner_t *combiner);
+
+// Add a soft complete frame. Returns SL_STATUS_OK and the combined packet if
+// at least min_frames frames are stored and every bit has a decision,
+// SL_STATUS_IN_PROGRESS if more frames are needed. Zero min_frames only
+// stores the frame (e.g. a clean frame that has been delivered on its own).
+sl_status_t hcs300_combiner_add(hcs300_combiner_t *combiner,
+                                const hcs300_decoder_t *decoder,
+                                uint8_t min_frames,
+                                hcs300_packet_t *packet);
+
+void hcs300_codeword_pack(const hcs300_protocol_t *protocol,
+                          const hcs300_packet_t *packet,
+                          hcs300_codeword_t *codeword);
+void hcs300_codeword_unpack(const hcs300_protocol_t *protocol,
+                            const hcs300_codeword_t *codeword,
+                            hcs300_packet_t *packet);
+
+uint8_t hcs300_packet_btn_status(const hcs300_packet_t *packet);
+
+// Append the data portion of a code word as chips (chips_per_te chips per TE,
+// LSB first in each byte) from chip_idx on. Returns the chip index after it.
+// Chips after the returned index in its byte may be left as they were.
+uint16_t hcs300_codeword_expand(const hcs300_protocol_t *protocol,
+                               const hcs300_codeword_t *codeword,
+                               uint16_t chips_per_te,
+                               uint8_t *chips,
+                               uint16_t chip_idx);
+
+// Append chip_cnt chips of one level and advance chip_idx
+void hcs300_chips_append_level(uint8_t *chips,
+                               uint16_t *chip_idx,
+                               uint16_t chip_cnt,
+                               bool high);
+
+// Clear the chips from chip_idx to the end of a len byte array
+void hcs300_chips_clear(uint8_t *chips, uint16_t chip_idx, uint16_t len);
+
+#endif // HCS300_DECODER_H
@@ -0,0 +1,106 @@
+// Equivalence of hcs300_codeword_expand (nibble LUT for the PWM protocols sent
+// with 1 chip per TE) and the bit at a time reference it replaced, on random
+// code words of every protocol, chip rate and start position
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+#include "hcs300_test_util.h"
+
+#define TEST_ITERATIONS     20000
+#define TEST_CHIPS_BYTES    128
+#define TEST_FILL           0xA5
+
+// Bit at a time encoder of the data portion, chips are only set (the array is
+// cleared from the start index on)
+static uint16_t ref_expand(const hcs300_protocol_t *protocol,
+                           const hcs300_codeword_t *codeword,
+                           uint16_t chips_per_te,
+                           uint8_t *chips,
+                           uint16_t chip_idx)
+{
+  for (uint8_t data_bit_idx = 0; data_bit_idx < protocol->data_bits; data_bit_idx++) {
+    uint8_t data_bit = (data_bit_idx < 64)
+                       ? (uint8_t)(codeword->word >> data_bit_idx) & 1
+                       : (uint8_t)(codeword->tail >> (data_bit_idx - 64)) & 1;
+    uint16_t level_te[2];
+    bool first_high;
+
+    switch (protocol->encoding) {
+      case HCS300_BIT_ENCODING_MANCHESTER:
+        level_te[0] = 1;
+        level_te[1] = 1;
+        first_high = data_bit != 0;
+        break;
+
+      case HCS300_BIT_ENCODING_VPWM:
+        level_te[0] = (data_bit != 0) ? 1 : 2;
+        level_te[1] = 0;
+        first_high = (data_bit_idx & 1) == 0;
+        break;
+
+      default:
+        level_te[0] = ((data_bit != 0) != (protocol->encoding == HCS300_BIT_ENCODING_PWM_INVERTED))
+                      ? 1
+                      : protocol->bit_te - 1;
+        level_te[1] = protocol->bit_te - level_te[0];
+        first_high = true;
+        break;
+    }
+
+    for (uint8_t level_idx = 0; level_idx < 2; level_idx++) {
+      bool high = (level_idx == 0) == first_high;
+
+      for (uint16_t chip_nr = 0; chip_nr < level_te[level_idx] * chips_per_te; chip_nr++, chip_idx++) {
+        if (high) {
+          chips[chip_idx >> 3] |= (uint8_t)(1 << (chip_idx & 0x7));
+        }
+      }
+    }
+  }
+
+  return chip_idx;
+}
+
+int main(void)
+{
+  uint32_t fail_cnt = 0;
+
+  for (uint32_t iteration = 0; iteration < TEST_ITERATIONS; iteration++) {
+    const hcs300_protocol_t *protocol = hcs300_test_protocols[iteration % hcs300_test_protocol_cnt];
+    // 1 chip per TE takes the LUT path, the rest the level path
+    uint16_t chips_per_te = (iteration & 1) ? 1 : 1 + hcs300_test_rand() % 4;
+    uint16_t start_idx = hcs300_test_rand() % 64;
+    hcs300_codeword_t codeword = {
+      .word = ((uint64_t) hcs300_test_rand() << 32) | hcs300_test_rand(),
+      .tail = (uint8_t) hcs300_test_rand(),
+    };
+    uint8_t chips[TEST_CHIPS_BYTES];
+    uint8_t ref_chips[TEST_CHIPS_BYTES];
+    uint16_t end_idx;
+    uint16_t ref_end_idx;
+
+    // Chips before the start index are kept, the rest starts out as garbage
+    for (uint16_t byte_idx = 0; byte_idx < TEST_CHIPS_BYTES; byte_idx++) {
+      chips[byte_idx] = (uint8_t) hcs300_test_rand();
+    }
+    memcpy(ref_chips, chips, sizeof(chips));
+    hcs300_chips_clear(ref_chips, start_idx, sizeof(ref_chips));
+    memset(&chips[(start_idx + 7) >> 3], TEST_FILL, sizeof(chips) - ((start_idx + 7) >> 3));
+
+    end_idx = hcs300_codeword_expand(protocol, &codeword, chips_per_te, chips, start_idx);
+    ref_end_idx = ref_expand(protocol, &codeword, chips_per_te, ref_chips, start_idx);
+
+    // Chips after the end index are not defined
+    hcs300_chips_clear(chips, end_idx, sizeof(chips));
+    if ((end_idx != ref_end_idx) || (memcmp(chips, ref_chips, sizeof(chips)) != 0)) {
+      hcs300_test_fail(&fail_cnt, "%s chips/TE %u start %u end %u/%u", protocol->name,
+                       chips_per_te, start_idx, end_idx, ref_end_idx);
+    }
+  }
+
+  return hcs300_test_summary("hcs300_codeword_expand", fail_cnt, TEST_ITERATIONS);
+}
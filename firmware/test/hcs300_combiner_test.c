@@ -0,0 +1,109 @@
+// Soft combiner of repeated KEELOQ frames: weak frames of one press are
+// combined, a frame of another transmitter (other serial number) doesn't vote
+// on them
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+#include "hcs300_test_util.h"
+
+// Weak bits are 35 % of TE off their levels, outside of the windows
+#define TEST_WEAK_TICKS     (HCS300_TEST_TE_TICKS * 35 / 100)
+
+static uint32_t fail_cnt;
+
+static void check(bool condition, const char *what)
+{
+  if (!condition) {
+    hcs300_test_fail(&fail_cnt, "%s", what);
+  }
+}
+
+// Feed a frame with every weak_every-th bit (from weak_first on) made weak,
+// returns the status of the decoder at the end of frame. No jitter, only the
+// weak bits are off their levels.
+static sl_status_t feed_frame(hcs300_decoder_t *decoder,
+                              const hcs300_codeword_t *codeword,
+                              uint8_t weak_first,
+                              uint8_t weak_every)
+{
+  uint32_t levels[HCS300_PROTOCOL_MAX_LEVELS + 1];
+  uint16_t level_cnt;
+  sl_status_t sc = SL_STATUS_IN_PROGRESS;
+
+  level_cnt = hcs300_test_build_levels(&hcs300_protocol_keeloq_pwm, codeword,
+                                       HCS300_TEST_TE_TICKS, 0, levels);
+  for (uint8_t bit_idx = weak_first; weak_every != 0 && bit_idx < HCS300_DATA_BITS; bit_idx += weak_every) {
+    // High and low level of the bit follow the preamble and the header
+    uint16_t level_idx = HCS300_PREAMBLE_TE + 1 + 2 * bit_idx;
+    bool bit = (bit_idx < 64)
+               ? (codeword->word >> bit_idx) & 1
+               : (codeword->tail >> (bit_idx - 64)) & 1;
+
+    levels[level_idx] = bit ? levels[level_idx] + TEST_WEAK_TICKS : levels[level_idx] - TEST_WEAK_TICKS;
+    if (level_idx + 1 < level_cnt) {
+      levels[level_idx + 1] = bit ? levels[level_idx + 1] - TEST_WEAK_TICKS : levels[level_idx + 1] + TEST_WEAK_TICKS;
+    }
+  }
+
+  hcs300_decoder_reset(decoder, &hcs300_test_decoder_config);
+  for (uint16_t level_idx = 0; level_idx < level_cnt; level_idx++) {
+    sc = hcs300_decoder_feed(decoder, levels[level_idx]);
+  }
+  return sc;
+}
+
+int main(void)
+{
+  hcs300_codeword_t codeword_a = {
+    .word = ((uint64_t) hcs300_test_rand() << 32) | hcs300_test_rand(),
+    .tail = hcs300_test_rand() & 0x3,
+  };
+  // Same button code (bits 60 on), only the serial numbers differ
+  hcs300_codeword_t codeword_b = {
+    .word = ((((uint64_t) hcs300_test_rand() << 32) | hcs300_test_rand()) & ((1ULL << 60) - 1))
+            | (codeword_a.word & ~((1ULL << 60) - 1)),
+    .tail = codeword_a.tail,
+  };
+  hcs300_decoder_t decoder;
+  hcs300_combiner_t combiner;
+  hcs300_packet_t clean_a;
+  hcs300_packet_t packet;
+  sl_status_t sc;
+
+  check(feed_frame(&decoder, &codeword_a, 0, 0) == SL_STATUS_OK, "clean frame decoded");
+  clean_a = decoder.data;
+
+  // Weak frames of one press, each bit is weak in one frame at most
+  hcs300_combiner_reset(&combiner);
+  for (uint8_t frame_idx = 0; frame_idx < 3; frame_idx++) {
+    sc = feed_frame(&decoder, &codeword_a, frame_idx, 9);
+    check(sc == SL_STATUS_INVALID_RANGE && hcs300_decoder_is_soft_complete(&decoder),
+          "weak frame soft complete");
+    sc = hcs300_combiner_add(&combiner, &decoder, 3, &packet);
+  }
+  check(sc == SL_STATUS_OK, "weak frames combined");
+  check(sc == SL_STATUS_OK
+        && packet.encrypted == clean_a.encrypted
+        && packet.serial == clean_a.serial,
+        "combined packet matches the clean one");
+
+  // A weak frame of another transmitter restarts the history instead of
+  // being combined with the frames of the first one
+  hcs300_combiner_reset(&combiner);
+  for (uint8_t frame_idx = 0; frame_idx < 2; frame_idx++) {
+    (void) feed_frame(&decoder, &codeword_a, frame_idx, 9);
+    (void) hcs300_combiner_add(&combiner, &decoder, 3, &packet);
+  }
+  (void) feed_frame(&decoder, &codeword_b, 2, 9);
+  sc = hcs300_combiner_add(&combiner, &decoder, 3, &packet);
+  check(sc == SL_STATUS_IN_PROGRESS, "frame of another serial number not combined");
+  check(combiner.frame_cnt == 1, "history restarted by another serial number");
+
+  printf("hcs300_combiner: %s\n", (fail_cnt == 0) ? "passed" : "failed");
+  return (fail_cnt == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
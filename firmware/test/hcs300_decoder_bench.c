@@ -0,0 +1,158 @@
+// Time per KEELOQ frame of the PWM data level classification: the per frame
+// tick windows of the decoder (plain comparisons) against the relative
+// tolerance checks they replaced (a multiply and a divide by 100 each, up to
+// four per bit), and of the whole decoder on the same frame.
+// The timings are taken on the host (clock_gettime), they compare the two
+// classifications but don't stand for the latency of the capture ISR on the
+// target, which can only be measured there.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+#include "hcs300_test_util.h"
+
+#define BENCH_FRAMES        200000
+#define BENCH_TOLERANCE_PCT 20
+
+static volatile uint32_t bench_sink;
+
+static uint16_t build_frame(uint32_t *levels)
+{
+  hcs300_codeword_t codeword = {
+    .word = ((uint64_t) hcs300_test_rand() << 32) | hcs300_test_rand(),
+    .tail = hcs300_test_rand() & 0x3,
+  };
+
+  return hcs300_test_build_levels(&hcs300_protocol_keeloq_pwm, &codeword,
+                                  HCS300_TEST_TE_TICKS, HCS300_TEST_JITTER_TICKS, levels);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static bool is_within_rel_tolerance(uint32_t value,
+                                    uint32_t target,
+                                    uint8_t rel_tolerance_pct)
+{
+  uint32_t tolerance = (target * rel_tolerance_pct) / 100;
+  return (value >= (target - tolerance)) && (value <= (target + tolerance));
+}
+
+// Classification before the windows, TE and the tolerance are not constant
+// from the compiler's point of view (tracked per frame)
+__attribute__((noinline))
+static uint32_t classify_rel_tolerance(const uint32_t *levels,
+                                       uint16_t level_cnt,
+                                       volatile const uint32_t *te_ticks,
+                                       volatile const uint8_t *tolerance_pct)
+{
+  uint32_t bits = 0;
+
+  for (uint16_t level_idx = 0; level_idx + 1 < level_cnt; level_idx += 2) {
+    uint32_t te = *te_ticks;
+    uint8_t pct = *tolerance_pct;
+    uint32_t high = levels[level_idx];
+    uint32_t low = levels[level_idx + 1];
+
+    if (is_within_rel_tolerance(high, 2 * te, pct) && is_within_rel_tolerance(low, te, pct)) {
+      bits = (bits << 1);
+    } else if (is_within_rel_tolerance(high, te, pct) && is_within_rel_tolerance(low, 2 * te, pct)) {
+      bits = (bits << 1) | 1;
+    }
+  }
+  return bits;
+}
+
+__attribute__((noinline))
+static uint32_t classify_windows(const uint32_t *levels,
+                                 uint16_t level_cnt,
+                                 volatile const hcs300_decoder_window_t *windows)
+{
+  uint32_t bits = 0;
+
+  for (uint16_t level_idx = 0; level_idx + 1 < level_cnt; level_idx += 2) {
+    uint32_t high = levels[level_idx];
+    uint32_t low = levels[level_idx + 1];
+
+    if (high >= windows[HCS300_SYMBOL_2TE].min_ticks && high <= windows[HCS300_SYMBOL_2TE].max_ticks
+        && low >= windows[HCS300_SYMBOL_1TE].min_ticks && low <= windows[HCS300_SYMBOL_1TE].max_ticks) {
+      bits = (bits << 1);
+    } else if (high >= windows[HCS300_SYMBOL_1TE].min_ticks && high <= windows[HCS300_SYMBOL_1TE].max_ticks
+               && low >= windows[HCS300_SYMBOL_2TE].min_ticks && low <= windows[HCS300_SYMBOL_2TE].max_ticks) {
+      bits = (bits << 1) | 1;
+    }
+  }
+  return bits;
+}
+
+int main(void)
+{
+  uint32_t levels[HCS300_PROTOCOL_MAX_LEVELS];
+  uint16_t level_cnt = build_frame(levels);
+  uint16_t data_idx = HCS300_PREAMBLE_TE + 1;
+  hcs300_decoder_t decoder;
+  hcs300_decoder_window_t windows[HCS300_SYMBOL_INVALID];
+  uint32_t te_ticks = HCS300_TEST_TE_TICKS;
+  uint8_t tolerance_pct = BENCH_TOLERANCE_PCT;
+  sl_status_t sc = SL_STATUS_IN_PROGRESS;
+  uint64_t start_ns;
+  double rel_ns;
+  double windows_ns;
+  double feed_ns;
+
+  hcs300_decoder_reset(&decoder, &hcs300_test_decoder_config);
+  for (uint16_t level_idx = 0; level_idx < level_cnt; level_idx++) {
+    sc = hcs300_decoder_feed(&decoder, levels[level_idx]);
+  }
+  if (sc != SL_STATUS_OK) {
+    printf("frame not decoded (0x%x)\n", (unsigned) sc);
+    return EXIT_FAILURE;
+  }
+  for (uint8_t symbol = 0; symbol < HCS300_SYMBOL_INVALID; symbol++) {
+    uint32_t target = ((symbol == HCS300_SYMBOL_2TE) ? 2 : 1) * HCS300_TEST_TE_TICKS;
+
+    windows[symbol].min_ticks = target - target * BENCH_TOLERANCE_PCT / 100;
+    windows[symbol].max_ticks = target + target * BENCH_TOLERANCE_PCT / 100;
+  }
+
+  start_ns = now_ns();
+  for (uint32_t frame_idx = 0; frame_idx < BENCH_FRAMES; frame_idx++) {
+    bench_sink += classify_rel_tolerance(&levels[data_idx], level_cnt - data_idx,
+                                         &te_ticks, &tolerance_pct);
+  }
+  rel_ns = (double)(now_ns() - start_ns) / BENCH_FRAMES;
+
+  start_ns = now_ns();
+  for (uint32_t frame_idx = 0; frame_idx < BENCH_FRAMES; frame_idx++) {
+    bench_sink += classify_windows(&levels[data_idx], level_cnt - data_idx, windows);
+  }
+  windows_ns = (double)(now_ns() - start_ns) / BENCH_FRAMES;
+
+  start_ns = now_ns();
+  for (uint32_t frame_idx = 0; frame_idx < BENCH_FRAMES; frame_idx++) {
+    hcs300_decoder_reset(&decoder, &hcs300_test_decoder_config);
+    for (uint16_t level_idx = 0; level_idx < level_cnt; level_idx++) {
+      sc = hcs300_decoder_feed(&decoder, levels[level_idx]);
+    }
+    bench_sink += sc;
+  }
+  feed_ns = (double)(now_ns() - start_ns) / BENCH_FRAMES;
+
+  printf("Host timings, not the target ISR latency\n");
+  printf("classification, relative tolerance: %8.1f ns/frame (host)\n", rel_ns);
+  printf("classification, tick windows:       %8.1f ns/frame (host)\n", windows_ns);
+  printf("hcs300_decoder_feed, whole frame:   %8.1f ns/frame (host)\n", feed_ns);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+// TE of relayed packets: the TE setting of KEELOQ encoders, the measured TE
+// of fixed-code encoders, on the chip grid of the PHY
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+#include "hcs300_test_util.h"
+
+typedef struct test_case {
+  const hcs300_protocol_t *protocol;
+  uint32_t te_nominal_us;
+  uint32_t te_measured_us;
+  uint16_t chip_us;
+  uint16_t te_us;
+} test_case_t;
+
+static const test_case_t test_cases[] = {
+  // Every TE setting is relayed, the shorter ones with the 400 us PHY chip
+  { &hcs300_protocol_keeloq_pwm, 100, 104, 400, 400 },
+  { &hcs300_protocol_keeloq_pwm, 200, 196, 400, 400 },
+  { &hcs300_protocol_keeloq_pwm, 400, 410, 400, 400 },
+  { &hcs300_protocol_hcs362_vpwm, 200, 203, 100, 200 },
+  // TE setting not detected, the measured TE is used
+  { &hcs300_protocol_keeloq_pwm, 0, 790, 400, 800 },
+  // Fixed-code TE is not classified
+  { &hcs300_protocol_ev1527, 400, 350, 100, 400 },
+  { &hcs300_protocol_ev1527, 400, 340, 100, 300 },
+  { &hcs300_protocol_pt2262, 0, 590, 400, 400 },
+  { &hcs300_protocol_pt2262, 0, 610, 400, 800 },
+  { &hcs300_protocol_ev1527, 0, 0, 400, 400 },
+  // No PHY bit period, nothing can be relayed
+  { &hcs300_protocol_keeloq_pwm, 400, 400, 0, 0 },
+};
+
+int main(void)
+{
+  uint32_t fail_cnt = 0;
+
+  for (uint32_t case_idx = 0; case_idx < sizeof(test_cases) / sizeof(test_cases[0]); case_idx++) {
+    const test_case_t *test_case = &test_cases[case_idx];
+    uint16_t te_us = hcs300_relay_te_us(test_case->protocol,
+                                        test_case->te_nominal_us,
+                                        test_case->te_measured_us,
+                                        test_case->chip_us);
+
+    if (te_us != test_case->te_us) {
+      hcs300_test_fail(&fail_cnt, "%s nominal %u measured %u chip %u: %u instead of %u",
+                       test_case->protocol->name,
+                       (unsigned) test_case->te_nominal_us,
+                       (unsigned) test_case->te_measured_us,
+                       (unsigned) test_case->chip_us,
+                       (unsigned) te_us,
+                       (unsigned) test_case->te_us);
+    }
+  }
+
+  if (fail_cnt != 0) {
+    return EXIT_FAILURE;
+  }
+  printf("hcs300_relay_te_us: passed\n");
+  return EXIT_SUCCESS;
+}
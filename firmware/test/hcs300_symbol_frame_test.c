@@ -0,0 +1,79 @@
+// Recorded symbol frames of every protocol decode to the packet of the frame
+// they were recorded from
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+#include "hcs300_test_util.h"
+
+#define TEST_FRAMES         200
+
+int main(void)
+{
+  uint32_t fail_cnt = 0;
+
+  for (uint32_t frame_idx = 0; frame_idx < TEST_FRAMES; frame_idx++) {
+    const hcs300_protocol_t *protocol = hcs300_test_protocols[frame_idx % hcs300_test_protocol_cnt];
+    hcs300_packet_t sent = {
+      .encrypted = hcs300_test_rand(),
+      .serial = hcs300_test_rand() & 0xFFFFFFF,
+      .s0 = hcs300_test_rand() & 1,
+      .s1 = hcs300_test_rand() & 1,
+      .s2 = hcs300_test_rand() & 1,
+      .s3 = hcs300_test_rand() & 1,
+      .vlow = hcs300_test_rand() & 1,
+      .rpt = hcs300_test_rand() & 1,
+      .trailer = hcs300_test_rand() & 0xF,
+    };
+    hcs300_codeword_t codeword;
+    hcs300_symbol_frame_t record;
+    hcs300_decoder_t decoder;
+    hcs300_packet_t replayed;
+    uint32_t levels[HCS300_PROTOCOL_MAX_LEVELS + 1];
+    uint16_t level_cnt;
+    sl_status_t sc = SL_STATUS_IN_PROGRESS;
+    sl_status_t replay_sc;
+
+    hcs300_codeword_pack(protocol, &sent, &codeword);
+    level_cnt = hcs300_test_build_levels(protocol, &codeword, HCS300_TEST_TE_TICKS,
+                                         HCS300_TEST_JITTER_TICKS, levels);
+
+    hcs300_decoder_reset(&decoder, &hcs300_test_decoder_config);
+    (void) hcs300_decoder_set_protocol(&decoder, protocol);
+    hcs300_decoder_set_record(&decoder, &record);
+    for (uint16_t level_idx = 0; level_idx < level_cnt; level_idx++) {
+      sc = hcs300_decoder_feed(&decoder, levels[level_idx]);
+    }
+
+    if (level_cnt - (protocol->preamble_te != 0 ? protocol->preamble_te + 1 : 0)
+        < hcs300_protocol_min_levels(protocol)) {
+      // The frame would be dropped as too short
+      hcs300_test_fail(&fail_cnt, "%s %u levels", protocol->name, (unsigned) level_cnt);
+    }
+
+    replay_sc = hcs300_symbol_frame_decode(&record, &replayed);
+    if (sc == SL_STATUS_OK
+        && replay_sc == SL_STATUS_OK
+        && protocol->preamble_te != 0
+        && protocol->encoding == HCS300_BIT_ENCODING_PWM) {
+      // A resynchronized frame (preamble lost) replays the same
+      hcs300_decoder_reset(&decoder, &hcs300_test_decoder_config);
+      (void) hcs300_decoder_set_protocol(&decoder, protocol);
+      hcs300_decoder_set_record(&decoder, &record);
+      sc = hcs300_decoder_resync(&decoder, &levels[protocol->preamble_te],
+                                 level_cnt - protocol->preamble_te);
+      replay_sc = hcs300_symbol_frame_decode(&record, &replayed);
+    }
+    if (sc != SL_STATUS_OK
+        || replay_sc != SL_STATUS_OK
+        || memcmp(&replayed, &decoder.data, sizeof(replayed)) != 0) {
+      hcs300_test_fail(&fail_cnt, "%s decode 0x%x replay 0x%x", protocol->name,
+                       (unsigned) sc, (unsigned) replay_sc);
+    }
+  }
+
+  return hcs300_test_summary("hcs300_symbol_frame_decode", fail_cnt, TEST_FRAMES);
+}
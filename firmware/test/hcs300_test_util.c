@@ -0,0 +1,112 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hcs300_test_util.h"
+
+// Chips of the longest frame at 1 chip per TE, with the preamble and header
+#define TEST_CHIPS_BYTES            64
+
+const hcs300_protocol_t *const hcs300_test_protocols[] = {
+  &hcs300_protocol_keeloq_pwm,
+  &hcs300_protocol_hcs362_pwm,
+  &hcs300_protocol_ev1527,
+  &hcs300_protocol_pt2262,
+  &hcs300_protocol_hcs361_manchester,
+  &hcs300_protocol_hcs361_vpwm,
+  &hcs300_protocol_hcs362_manchester,
+  &hcs300_protocol_hcs362_vpwm,
+};
+
+const uint8_t hcs300_test_protocol_cnt = sizeof(hcs300_test_protocols)
+                                         / sizeof(hcs300_test_protocols[0]);
+
+const hcs300_decoder_config_t hcs300_test_decoder_config = {
+  .min_preamble_pulses = 6,
+  .te_tolerance_init_pct = 20,
+  .te_tolerance_prec_pct = 2,
+  .te_tracking_shift = 3,
+  .max_weak_bits = 8,
+};
+
+static uint64_t rand_state = 0x2545F4914F6CDD1DULL;
+
+void hcs300_test_seed(uint64_t seed)
+{
+  // Zero would stick
+  rand_state = (seed != 0) ? seed : 0x2545F4914F6CDD1DULL;
+}
+
+uint32_t hcs300_test_rand(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return (uint32_t)(rand_state >> 32);
+}
+
+static bool get_chip(const uint8_t *chips, uint16_t chip_idx)
+{
+  return (chips[chip_idx >> 3] >> (chip_idx & 0x7)) & 1;
+}
+
+uint16_t hcs300_test_build_levels(const hcs300_protocol_t *protocol,
+                                  const hcs300_codeword_t *codeword,
+                                  uint32_t te_ticks,
+                                  uint32_t jitter_ticks,
+                                  uint32_t *levels)
+{
+  uint8_t chips[TEST_CHIPS_BYTES] = { 0 };
+  uint16_t chip_idx = 0;
+  uint16_t chip_cnt;
+  uint16_t level_cnt = 0;
+  uint16_t run = 0;
+
+  // Fixed-code frames are split at the sync low, they start with the data
+  if (protocol->preamble_te != 0) {
+    for (uint8_t te_idx = 0; te_idx < protocol->preamble_te; te_idx++) {
+      hcs300_chips_append_level(chips, &chip_idx, 1, (te_idx & 1) == 0);
+    }
+    hcs300_chips_append_level(chips, &chip_idx, protocol->header_te, false);
+  }
+  chip_cnt = hcs300_codeword_expand(protocol, codeword, 1, chips, chip_idx);
+
+  // Run lengths of the chips, the trailing low run is the guard time
+  for (chip_idx = 0; chip_idx < chip_cnt; chip_idx++) {
+    bool high = get_chip(chips, chip_idx);
+
+    run++;
+    if (chip_idx + 1 == chip_cnt || get_chip(chips, chip_idx + 1) != high) {
+      int32_t jitter = (jitter_ticks != 0)
+                       ? (int32_t)(hcs300_test_rand() % (2 * jitter_ticks + 1)) - (int32_t) jitter_ticks
+                       : 0;
+
+      if (high || chip_idx + 1 < chip_cnt) {
+        levels[level_cnt++] = (uint32_t)((int32_t)(run * te_ticks) + jitter);
+      }
+      run = 0;
+    }
+  }
+
+  return level_cnt;
+}
+
+void hcs300_test_fail(uint32_t *fail_cnt, const char *format, ...)
+{
+  va_list args;
+
+  if ((*fail_cnt)++ >= HCS300_TEST_MAX_REPORTED) {
+    return;
+  }
+  va_start(args, format);
+  printf("FAIL ");
+  vprintf(format, args);
+  printf("\n");
+  va_end(args);
+}
+
+int hcs300_test_summary(const char *name, uint32_t fail_cnt, uint32_t total)
+{
+  printf("%s: %u/%u equal\n", name, (unsigned)(total - fail_cnt), (unsigned) total);
+  return (fail_cnt == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,48 @@
+#ifndef HCS300_TEST_UTIL_H
+#define HCS300_TEST_UTIL_H
+
+// Fixture shared by the host tests: frames of the supported protocols as the
+// capture timer of the target sees them
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hcs300.h"
+#include "hcs300_decoder.h"
+
+// Timer ticks of the target (39 MHz HFXO), TE of 400 us and the edge jitter
+// of the demodulator (10 us)
+#define HCS300_TEST_TE_TICKS        15600
+#define HCS300_TEST_JITTER_TICKS    390
+
+// Failures printed in detail, the rest is only counted
+#define HCS300_TEST_MAX_REPORTED    8
+
+extern const hcs300_protocol_t *const hcs300_test_protocols[];
+extern const uint8_t hcs300_test_protocol_cnt;
+
+// Decoder configuration of the firmware
+extern const hcs300_decoder_config_t hcs300_test_decoder_config;
+
+// Deterministic on every host (xorshift)
+void hcs300_test_seed(uint64_t seed);
+uint32_t hcs300_test_rand(void);
+
+// Levels of a frame from its first high level on, each one a whole number
+// of TE plus a uniform jitter of +-jitter_ticks. The low level after the last
+// high one is the guard time, it isn't a level. Fixed-code frames are split at
+// the sync low, they start with the data. Returns the number of levels.
+uint16_t hcs300_test_build_levels(const hcs300_protocol_t *protocol,
+                                  const hcs300_codeword_t *codeword,
+                                  uint32_t te_ticks,
+                                  uint32_t jitter_ticks,
+                                  uint32_t *levels);
+
+// Count a failed check, the first ones are printed with what failed
+void hcs300_test_fail(uint32_t *fail_cnt, const char *format, ...)
+__attribute__((format(printf, 2, 3)));
+
+// Print the "name: passed/total equal" summary, returns the exit code
+int hcs300_test_summary(const char *name, uint32_t fail_cnt, uint32_t total);
+
+#endif // HCS300_TEST_UTIL_H
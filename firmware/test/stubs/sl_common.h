@@ -0,0 +1,11 @@
+#ifndef SL_COMMON_H
+#define SL_COMMON_H
+
+// Host stand-in for the SDK header
+
+#define SL_MIN(a, b)    (((a) < (b)) ? (a) : (b))
+#define SL_MAX(a, b)    (((a) > (b)) ? (a) : (b))
+
+#define SL_WEAK         __attribute__((weak))
+
+#endif // SL_COMMON_H
@@ -0,0 +1,18 @@
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+// Host stand-in for the SDK header, only the codes used by the pure modules
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                  ((sl_status_t)0x0000)
+#define SL_STATUS_FAIL                ((sl_status_t)0x0001)
+#define SL_STATUS_IN_PROGRESS         ((sl_status_t)0x0005)
+#define SL_STATUS_NOT_SUPPORTED       ((sl_status_t)0x000F)
+#define SL_STATUS_INVALID_PARAMETER   ((sl_status_t)0x0021)
+#define SL_STATUS_INVALID_RANGE       ((sl_status_t)0x0028)
+#define SL_STATUS_INVALID_COUNT       ((sl_status_t)0x002B)
+
+#endif // SL_STATUS_H